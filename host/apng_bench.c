@@ -0,0 +1,727 @@
+// Decode benchmark for the Boris APNGs in resources/data.
+//
+// Decodes each animation frame by frame the way the firmware's upng based
+// PNG decoder does: the frame's compressed chunks are gathered, inflated
+// whole, unfiltered and composited onto the canvas, honouring the fcTL
+// dispose and blend operations like tools/apng.py. Prints one tab separated
+// row per animation, or per frame with --frames. See host/README.md.
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define DISPOSE_BACKGROUND 1
+#define DISPOSE_PREVIOUS 2
+#define BLEND_SOURCE 0
+
+static struct {
+  int repeat;
+  bool frames;
+} options = {
+  .repeat = 20
+};
+
+// Scratch memory, everything the decoder allocates besides the file itself,
+// which stays in flash on the watch
+
+static size_t scratchUsed;
+static size_t scratchPeak;
+
+static void *scratchAlloc(size_t size) {
+  size_t *block = malloc(sizeof(size_t) + size);
+  if(block == NULL) {
+    fprintf(stderr, "Out of memory\n");
+    exit(1);
+  }
+  block[0] = size;
+  scratchUsed += size;
+  if(scratchUsed > scratchPeak) {
+    scratchPeak = scratchUsed;
+  }
+  return block + 1;
+}
+
+static void scratchFree(void *data) {
+  if(data != NULL) {
+    size_t *block = (size_t *)data - 1;
+    scratchUsed -= block[0];
+    free(block);
+  }
+}
+
+static double nowUs(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static uint32_t be32(const uint8_t *data) {
+  return ((uint32_t)data[0] << 24) | (data[1] << 16) | (data[2] << 8) | data[3];
+}
+
+static uint16_t be16(const uint8_t *data) {
+  return (data[0] << 8) | data[1];
+}
+
+// Inflate, canonical Huffman codes decoded a bit at a time like upng
+
+#define MAX_BITS 15
+#define MAX_SYMBOLS 288
+
+typedef struct Huffman {
+  uint16_t count[MAX_BITS + 1];
+  uint16_t symbol[MAX_SYMBOLS];
+} Huffman;
+
+typedef struct Inflater {
+  const uint8_t *in;
+  size_t inSize;
+  size_t inPos;
+  uint32_t bitBuf;
+  int bitCount;
+  uint8_t *out;
+  size_t outSize;
+  size_t outPos;
+  // Set when the input runs out
+  bool bad;
+} Inflater;
+
+static const uint16_t LENGTH_BASE[29] = {
+  3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+  35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+};
+static const uint8_t LENGTH_EXTRA[29] = {
+  0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+};
+static const uint16_t DIST_BASE[30] = {
+  1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+  257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577
+};
+static const uint8_t DIST_EXTRA[30] = {
+  0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13
+};
+static const uint8_t CODE_ORDER[19] = {
+  16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15
+};
+
+static uint32_t bits(Inflater *s, int need) {
+  uint32_t value = s->bitBuf;
+  while(s->bitCount < need) {
+    if(s->inPos == s->inSize) {
+      s->bad = true;
+      return 0;
+    }
+    value |= (uint32_t)s->in[s->inPos++] << s->bitCount;
+    s->bitCount += 8;
+  }
+  s->bitBuf = value >> need;
+  s->bitCount -= need;
+  return value & ((1u << need) - 1);
+}
+
+static int decode(Inflater *s, const Huffman *h) {
+  int code = 0;
+  int first = 0;
+  int index = 0;
+  for(int len = 1; len <= MAX_BITS; len++) {
+    code |= bits(s, 1);
+    int count = h->count[len];
+    if(code - count < first) {
+      return h->symbol[index + (code - first)];
+    }
+    index += count;
+    first = (first + count) << 1;
+    code <<= 1;
+  }
+  return -1;
+}
+
+// Returns 0 for a complete code, more for an incomplete one and less than 0
+// for an over-subscribed one
+static int construct(Huffman *h, const uint16_t *length, int n) {
+  memset(h->count, 0, sizeof(h->count));
+  for(int i = 0; i < n; i++) {
+    h->count[length[i]]++;
+  }
+  if(h->count[0] == n) {
+    return 0;
+  }
+  int left = 1;
+  for(int len = 1; len <= MAX_BITS; len++) {
+    left = (left << 1) - h->count[len];
+    if(left < 0) {
+      return left;
+    }
+  }
+  uint16_t offsets[MAX_BITS + 1];
+  offsets[1] = 0;
+  for(int len = 1; len < MAX_BITS; len++) {
+    offsets[len + 1] = offsets[len] + h->count[len];
+  }
+  for(int i = 0; i < n; i++) {
+    if(length[i] != 0) {
+      h->symbol[offsets[length[i]]++] = i;
+    }
+  }
+  return left;
+}
+
+static bool inflateCodes(Inflater *s, const Huffman *lengths, const Huffman *distances) {
+  for(;;) {
+    int symbol = decode(s, lengths);
+    if(s->bad || symbol < 0) {
+      return false;
+    }
+    if(symbol < 256) {
+      if(s->outPos == s->outSize) {
+        return false;
+      }
+      s->out[s->outPos++] = symbol;
+    } else if(symbol == 256) {
+      return true;
+    } else {
+      symbol -= 257;
+      if(symbol >= 29) {
+        return false;
+      }
+      size_t len = LENGTH_BASE[symbol] + bits(s, LENGTH_EXTRA[symbol]);
+      int code = decode(s, distances);
+      if(code < 0 || code >= 30) {
+        return false;
+      }
+      size_t dist = DIST_BASE[code] + bits(s, DIST_EXTRA[code]);
+      if(s->bad || dist > s->outPos || len > s->outSize - s->outPos) {
+        return false;
+      }
+      for(; len > 0; len--, s->outPos++) {
+        s->out[s->outPos] = s->out[s->outPos - dist];
+      }
+    }
+  }
+}
+
+static bool inflateStored(Inflater *s) {
+  s->bitBuf = 0;
+  s->bitCount = 0;
+  if(s->inSize - s->inPos < 4) {
+    return false;
+  }
+  size_t len = s->in[s->inPos] | (s->in[s->inPos + 1] << 8);
+  size_t check = s->in[s->inPos + 2] | (s->in[s->inPos + 3] << 8);
+  s->inPos += 4;
+  if(len != (~check & 0xffff) || len > s->inSize - s->inPos || len > s->outSize - s->outPos) {
+    return false;
+  }
+  memcpy(s->out + s->outPos, s->in + s->inPos, len);
+  s->inPos += len;
+  s->outPos += len;
+  return true;
+}
+
+static bool inflateFixed(Inflater *s, Huffman *tables) {
+  uint16_t lengths[MAX_SYMBOLS];
+  for(int i = 0; i < MAX_SYMBOLS; i++) {
+    lengths[i] = i < 144 ? 8 : i < 256 ? 9 : i < 280 ? 7 : 8;
+  }
+  construct(&tables[0], lengths, MAX_SYMBOLS);
+  for(int i = 0; i < 30; i++) {
+    lengths[i] = 5;
+  }
+  construct(&tables[1], lengths, 30);
+  return inflateCodes(s, &tables[0], &tables[1]);
+}
+
+static bool inflateDynamic(Inflater *s, Huffman *tables) {
+  uint16_t lengths[320];
+  int literals = bits(s, 5) + 257;
+  int distances = bits(s, 5) + 1;
+  int codes = bits(s, 4) + 4;
+  if(s->bad || literals > 286 || distances > 30) {
+    return false;
+  }
+  for(int i = 0; i < 19; i++) {
+    lengths[CODE_ORDER[i]] = i < codes ? bits(s, 3) : 0;
+  }
+  if(construct(&tables[0], lengths, 19) != 0) {
+    return false;
+  }
+  int index = 0;
+  while(index < literals + distances) {
+    int symbol = decode(s, &tables[0]);
+    if(s->bad || symbol < 0) {
+      return false;
+    }
+    if(symbol < 16) {
+      lengths[index++] = symbol;
+      continue;
+    }
+    uint16_t len = 0;
+    int repeat;
+    if(symbol == 16) {
+      if(index == 0) {
+        return false;
+      }
+      len = lengths[index - 1];
+      repeat = 3 + bits(s, 2);
+    } else if(symbol == 17) {
+      repeat = 3 + bits(s, 3);
+    } else {
+      repeat = 11 + bits(s, 7);
+    }
+    if(index + repeat > literals + distances) {
+      return false;
+    }
+    while(repeat-- > 0) {
+      lengths[index++] = len;
+    }
+  }
+  if(lengths[256] == 0) {
+    return false;
+  }
+  int left = construct(&tables[0], lengths, literals);
+  if(left < 0 || (left > 0 && literals - tables[0].count[0] != 1)) {
+    return false;
+  }
+  left = construct(&tables[1], lengths + literals, distances);
+  if(left < 0 || (left > 0 && distances - tables[1].count[0] != 1)) {
+    return false;
+  }
+  return inflateCodes(s, &tables[0], &tables[1]);
+}
+
+// Inflates a zlib stream into out, returns the number of bytes written or -1
+static long inflateZlib(const uint8_t *in, size_t inSize, uint8_t *out, size_t outSize) {
+  if(inSize < 2 || (in[0] & 0x0f) != 8 || ((in[0] << 8) | in[1]) % 31 != 0 || (in[1] & 0x20)) {
+    return -1;
+  }
+  Inflater s = { .in = in, .inSize = inSize, .inPos = 2, .out = out, .outSize = outSize };
+  // upng keeps its code trees on the heap, so they count as scratch
+  Huffman *tables = scratchAlloc(2 * sizeof(Huffman));
+  bool ok;
+  bool last;
+  do {
+    last = bits(&s, 1);
+    switch(bits(&s, 2)) {
+      case 0:
+        ok = inflateStored(&s);
+        break;
+      case 1:
+        ok = inflateFixed(&s, tables);
+        break;
+      case 2:
+        ok = inflateDynamic(&s, tables);
+        break;
+      default:
+        ok = false;
+        break;
+    }
+  } while(ok && !s.bad && !last);
+  scratchFree(tables);
+  return ok && !s.bad ? (long)s.outPos : -1;
+}
+
+// PNG filters, undone in place. Rows are a filter byte then stride bytes
+
+static uint8_t paeth(int a, int b, int c) {
+  int p = a + b - c;
+  int pa = abs(p - a);
+  int pb = abs(p - b);
+  int pc = abs(p - c);
+  if(pa <= pb && pa <= pc) {
+    return a;
+  }
+  return pb <= pc ? b : c;
+}
+
+static bool unfilter(uint8_t *data, uint32_t height, uint32_t stride, int bpp) {
+  const uint8_t *prev = NULL;
+  for(uint32_t y = 0; y < height; y++) {
+    uint8_t kind = data[0];
+    uint8_t *line = data + 1;
+    for(uint32_t i = 0; i < stride; i++) {
+      int left = i >= (uint32_t)bpp ? line[i - bpp] : 0;
+      int up = prev != NULL ? prev[i] : 0;
+      int upLeft = prev != NULL && i >= (uint32_t)bpp ? prev[i - bpp] : 0;
+      switch(kind) {
+        case 0:
+          break;
+        case 1:
+          line[i] += left;
+          break;
+        case 2:
+          line[i] += up;
+          break;
+        case 3:
+          line[i] += (left + up) >> 1;
+          break;
+        case 4:
+          line[i] += paeth(left, up, upLeft);
+          break;
+        default:
+          return false;
+      }
+    }
+    prev = line;
+    data += stride + 1;
+  }
+  return true;
+}
+
+// Animation
+
+typedef struct Image {
+  uint32_t width;
+  uint32_t height;
+  uint8_t colorType;
+  int bpp;
+  uint8_t palette[256][4];
+} Image;
+
+typedef struct FrameControl {
+  uint32_t width;
+  uint32_t height;
+  uint32_t x;
+  uint32_t y;
+  uint16_t delayMs;
+  uint8_t dispose;
+  uint8_t blend;
+} FrameControl;
+
+typedef struct FrameStats {
+  uint32_t bytes;
+  uint16_t delayMs;
+  double decodeUs;
+  // Changed rectangle against the previous frame
+  uint32_t x;
+  uint32_t y;
+  uint32_t w;
+  uint32_t h;
+} FrameStats;
+
+static void pixelAt(const Image *image, const uint8_t *line, uint32_t x, uint8_t *rgba) {
+  switch(image->colorType) {
+    case 0:
+      rgba[0] = rgba[1] = rgba[2] = line[x];
+      rgba[3] = 255;
+      break;
+    case 2:
+      memcpy(rgba, line + x * 3, 3);
+      rgba[3] = 255;
+      break;
+    case 3:
+      memcpy(rgba, image->palette[line[x]], 4);
+      break;
+    case 4:
+      rgba[0] = rgba[1] = rgba[2] = line[x * 2];
+      rgba[3] = line[x * 2 + 1];
+      break;
+    default:
+      memcpy(rgba, line + x * 4, 4);
+      break;
+  }
+}
+
+static void blendOver(uint8_t *under, const uint8_t *over) {
+  int a = over[3];
+  if(a == 255 || under[3] == 0) {
+    memcpy(under, over, 4);
+    return;
+  }
+  if(a == 0) {
+    return;
+  }
+  int outA = a + under[3] * (255 - a) / 255;
+  for(int i = 0; i < 3; i++) {
+    under[i] = (over[i] * a + under[i] * under[3] * (255 - a) / 255) / outA;
+  }
+  under[3] = outA;
+}
+
+// Gathers the data chunks that follow the fcTL at pos into one buffer, the
+// way upng concatenates IDATs before inflating
+static uint8_t *gatherFrame(const uint8_t *file, size_t size, size_t pos, size_t *gathered) {
+  size_t total = 0;
+  for(size_t at = pos; at + 12 <= size; at += 12 + be32(file + at)) {
+    const uint8_t *kind = file + at + 4;
+    if(!memcmp(kind, "IDAT", 4)) {
+      total += be32(file + at);
+    } else if(!memcmp(kind, "fdAT", 4)) {
+      total += be32(file + at) - 4;
+    } else if(!memcmp(kind, "fcTL", 4) || !memcmp(kind, "IEND", 4)) {
+      break;
+    }
+  }
+  uint8_t *data = scratchAlloc(total);
+  *gathered = 0;
+  for(size_t at = pos; at + 12 <= size && *gathered < total; at += 12 + be32(file + at)) {
+    const uint8_t *kind = file + at + 4;
+    uint32_t len = be32(file + at);
+    if(!memcmp(kind, "IDAT", 4)) {
+      memcpy(data + *gathered, file + at + 8, len);
+      *gathered += len;
+    } else if(!memcmp(kind, "fdAT", 4)) {
+      memcpy(data + *gathered, file + at + 12, len - 4);
+      *gathered += len - 4;
+    }
+  }
+  return data;
+}
+
+static void changedRect(const uint8_t *prev, const uint8_t *cur, const Image *image, FrameStats *frame) {
+  uint32_t minX = image->width;
+  uint32_t minY = image->height;
+  uint32_t maxX = 0;
+  uint32_t maxY = 0;
+  for(uint32_t y = 0; y < image->height; y++) {
+    for(uint32_t x = 0; x < image->width; x++) {
+      size_t at = (y * image->width + x) * 4;
+      if(memcmp(prev + at, cur + at, 4) != 0) {
+        minX = x < minX ? x : minX;
+        minY = y < minY ? y : minY;
+        maxX = x > maxX ? x : maxX;
+        maxY = y > maxY ? y : maxY;
+      }
+    }
+  }
+  if(minX > maxX) {
+    frame->x = frame->y = frame->w = frame->h = 0;
+    return;
+  }
+  frame->x = minX;
+  frame->y = minY;
+  frame->w = maxX - minX + 1;
+  frame->h = maxY - minY + 1;
+}
+
+// Decodes every frame once, adding the time each took to frames[]. Returns
+// the number of frames, or -1 if the file can't be decoded
+static int decodeAnimation(const uint8_t *file, size_t size, FrameStats *frames, int maxFrames) {
+  Image image = { 0 };
+  uint8_t *canvas = NULL;
+  uint8_t *before = NULL;
+  // Only used to measure the changed rectangles
+  uint8_t *shown = NULL;
+  int count = 0;
+  bool failed = false;
+  for(size_t pos = 8; pos + 12 <= size && !failed; pos += 12 + be32(file + pos)) {
+    const uint8_t *body = file + pos + 8;
+    const uint8_t *kind = file + pos + 4;
+    uint32_t len = be32(file + pos);
+    if(!memcmp(kind, "IHDR", 4)) {
+      image.width = be32(body);
+      image.height = be32(body + 4);
+      image.colorType = body[9];
+      static const int BPP[7] = { 1, 0, 3, 1, 2, 0, 4 };
+      image.bpp = image.colorType < 7 ? BPP[image.colorType] : 0;
+      if(body[8] != 8 || image.bpp == 0 || body[12] != 0) {
+        fprintf(stderr, "Only 8-bit non-interlaced PNGs are supported\n");
+        failed = true;
+        break;
+      }
+      size_t canvasSize = (size_t)image.width * image.height * 4;
+      canvas = scratchAlloc(canvasSize);
+      memset(canvas, 0, canvasSize);
+      shown = calloc(1, canvasSize);
+    } else if(!memcmp(kind, "PLTE", 4)) {
+      for(uint32_t i = 0; i < len / 3 && i < 256; i++) {
+        memcpy(image.palette[i], body + i * 3, 3);
+        image.palette[i][3] = 255;
+      }
+    } else if(!memcmp(kind, "tRNS", 4)) {
+      for(uint32_t i = 0; i < len && i < 256; i++) {
+        image.palette[i][3] = body[i];
+      }
+    } else if(!memcmp(kind, "fcTL", 4) && canvas != NULL) {
+      if(count == maxFrames) {
+        fprintf(stderr, "Too many frames\n");
+        failed = true;
+        break;
+      }
+      FrameControl control = {
+        .width = be32(body + 4),
+        .height = be32(body + 8),
+        .x = be32(body + 12),
+        .y = be32(body + 16),
+        .dispose = body[24],
+        .blend = body[25]
+      };
+      // A zero denominator means hundredths of a second
+      uint16_t den = be16(body + 22);
+      control.delayMs = (uint16_t)((1000.0 * be16(body + 20)) / (den != 0 ? den : 100) + 0.5);
+      if(control.x + control.width > image.width || control.y + control.height > image.height) {
+        failed = true;
+        break;
+      }
+      FrameStats *frame = &frames[count++];
+      frame->delayMs = control.delayMs;
+
+      double start = nowUs();
+      size_t gathered;
+      uint8_t *compressed = gatherFrame(file, size, pos + 12 + len, &gathered);
+      uint32_t stride = control.width * image.bpp;
+      size_t rawSize = (size_t)control.height * (stride + 1);
+      uint8_t *raw = scratchAlloc(rawSize);
+      failed = inflateZlib(compressed, gathered, raw, rawSize) != (long)rawSize ||
+               !unfilter(raw, control.height, stride, image.bpp);
+      scratchFree(compressed);
+      if(!failed) {
+        if(control.dispose == DISPOSE_PREVIOUS) {
+          before = before != NULL ? before : scratchAlloc((size_t)image.width * image.height * 4);
+          memcpy(before, canvas, (size_t)image.width * image.height * 4);
+        }
+        for(uint32_t y = 0; y < control.height; y++) {
+          const uint8_t *line = raw + y * (stride + 1) + 1;
+          uint8_t *out = canvas + ((control.y + y) * image.width + control.x) * 4;
+          for(uint32_t x = 0; x < control.width; x++, out += 4) {
+            uint8_t rgba[4];
+            pixelAt(&image, line, x, rgba);
+            if(control.blend == BLEND_SOURCE) {
+              memcpy(out, rgba, 4);
+            } else {
+              blendOver(out, rgba);
+            }
+          }
+        }
+      }
+      scratchFree(raw);
+      frame->decodeUs += nowUs() - start;
+      frame->bytes = gathered;
+      if(failed) {
+        break;
+      }
+
+      changedRect(shown, canvas, &image, frame);
+      memcpy(shown, canvas, (size_t)image.width * image.height * 4);
+      if(control.dispose == DISPOSE_BACKGROUND) {
+        for(uint32_t y = 0; y < control.height; y++) {
+          memset(canvas + ((control.y + y) * image.width + control.x) * 4, 0, control.width * 4);
+        }
+      } else if(control.dispose == DISPOSE_PREVIOUS) {
+        memcpy(canvas, before, (size_t)image.width * image.height * 4);
+      }
+    }
+  }
+  scratchFree(canvas);
+  scratchFree(before);
+  free(shown);
+  return failed || count == 0 ? -1 : count;
+}
+
+// Report
+
+#define MAX_FRAMES 256
+
+static const char *baseName(const char *path, char *name, size_t size) {
+  const char *slash = strrchr(path, '/');
+  snprintf(name, size, "%s", slash != NULL ? slash + 1 : path);
+  char *dot = strrchr(name, '.');
+  if(dot != NULL) {
+    *dot = '\0';
+  }
+  return name;
+}
+
+static bool benchFile(const char *path) {
+  FILE *f = fopen(path, "rb");
+  if(f == NULL) {
+    fprintf(stderr, "Can't open %s\n", path);
+    return false;
+  }
+  fseek(f, 0, SEEK_END);
+  size_t size = ftell(f);
+  fseek(f, 0, SEEK_SET);
+  uint8_t *file = malloc(size);
+  size_t read = fread(file, 1, size, f);
+  fclose(f);
+  if(read != size || size < 8 || memcmp(file, "\x89PNG\r\n\x1a\n", 8) != 0) {
+    fprintf(stderr, "%s is not a PNG\n", path);
+    free(file);
+    return false;
+  }
+
+  static FrameStats frames[MAX_FRAMES];
+  memset(frames, 0, sizeof(frames));
+  scratchPeak = 0;
+  int count = -1;
+  for(int i = 0; i < options.repeat; i++) {
+    count = decodeAnimation(file, size, frames, MAX_FRAMES);
+    if(count < 0) {
+      fprintf(stderr, "Can't decode %s\n", path);
+      free(file);
+      return false;
+    }
+  }
+  free(file);
+
+  char name[64];
+  baseName(path, name, sizeof(name));
+  if(options.frames) {
+    for(int i = 0; i < count; i++) {
+      FrameStats *frame = &frames[i];
+      printf("%s\t%d\t%u\t%u\t%.2f\t%u\t%u\t%u\t%u\n", name, i, frame->delayMs, frame->bytes,
+             frame->decodeUs / options.repeat, frame->x, frame->y, frame->w, frame->h);
+    }
+    return true;
+  }
+  double bytes = 0;
+  double decodeUs = 0;
+  double maxUs = 0;
+  double dirty = 0;
+  uint32_t maxDirty = 0;
+  for(int i = 0; i < count; i++) {
+    FrameStats *frame = &frames[i];
+    double us = frame->decodeUs / options.repeat;
+    bytes += frame->bytes;
+    decodeUs += us;
+    maxUs = us > maxUs ? us : maxUs;
+    dirty += frame->w * frame->h;
+    maxDirty = frame->w * frame->h > maxDirty ? frame->w * frame->h : maxDirty;
+  }
+  printf("%s\t%d\t%zu\t%.1f\t%.2f\t%.2f\t%.1f\t%zu\t%.1f\t%u\n", name, count, size, bytes / count,
+         decodeUs / count, maxUs, decodeUs, scratchPeak, dirty / count, maxDirty);
+  return true;
+}
+
+static void usage(const char *name) {
+  fprintf(stderr,
+          "Usage: %s [options] file.png...\n"
+          "  --repeat N   decode each file N times and average (default 20)\n"
+          "  --frames     one row per frame instead of per file\n"
+          "\n"
+          "Per file columns: name, frames, file bytes, compressed bytes per frame,\n"
+          "decode us per frame, slowest frame us, decode us per play, peak scratch\n"
+          "bytes, changed pixels per frame, most changed pixels in a frame.\n"
+          "Per frame columns: name, frame, delay ms, compressed bytes, decode us,\n"
+          "and the changed rectangle x, y, w, h.\n", name);
+  exit(2);
+}
+
+int main(int argc, char **argv) {
+  int first = 1;
+  for(; first < argc && !strncmp(argv[first], "--", 2); first++) {
+    if(!strcmp(argv[first], "--repeat") && first + 1 < argc) {
+      options.repeat = atoi(argv[++first]);
+    } else if(!strcmp(argv[first], "--frames")) {
+      options.frames = true;
+    } else {
+      usage(argv[0]);
+    }
+  }
+  if(first == argc || options.repeat <= 0) {
+    usage(argv[0]);
+  }
+  if(options.frames) {
+    printf("name\tframe\tdelay_ms\tbytes\tdecode_us\tx\ty\tw\th\n");
+  } else {
+    printf("name\tframes\tfile_bytes\tbytes_per_frame\tdecode_us_per_frame\tdecode_us_max\t"
+           "decode_us_per_play\tscratch_peak\tdirty_px_per_frame\tdirty_px_max\n");
+  }
+  bool ok = true;
+  for(int i = first; i < argc; i++) {
+    ok = benchFile(argv[i]) && ok;
+  }
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,34 @@
+# Generates the RESOURCE_ID_* and MESSAGE_KEY_* definitions for the host
+# build from package.json, the way the Pebble SDK does for the watch build.
+
+import json
+import sys
+
+
+def main(package_path):
+    with open(package_path) as f:
+        package = json.load(f)['pebble']
+    out = ['// Generated by host/gen_ids.py from package.json, do not edit', '#pragma once', '']
+    media = package['resources']['media']
+    for i, resource in enumerate(media):
+        out.append('#define RESOURCE_ID_{} {}'.format(resource['name'], i + 1))
+    out.append('#define HOST_RESOURCE_COUNT {}'.format(len(media)))
+    out.append('static const char *const host_resource_files[] = {')
+    out.append('  NULL,')
+    for resource in media:
+        out.append('  "{}",'.format(resource['file']))
+    out.append('};')
+    out.append('static const char *const host_resource_names[] = {')
+    out.append('  NULL,')
+    for resource in media:
+        out.append('  "{}",'.format(resource['name']))
+    out.append('};')
+    out.append('')
+    for i, key in enumerate(package['messageKeys']):
+        name = key.split('[')[0]
+        out.append('#define MESSAGE_KEY_{} {}'.format(name, 10000 + i))
+    print('\n'.join(out))
+
+
+if __name__ == '__main__':
+    main(sys.argv[1])
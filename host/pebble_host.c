@@ -0,0 +1,1684 @@
+// Host implementation of the Pebble SDK subset declared in pebble.h.
+//
+// Runs the watchface against a virtual clock for a simulated day and reports
+// how much work it did: timer wakeups, resource reads, redrawn area and a rough
+// energy score, per hour and per behaviour. See host/README.md.
+
+#include <pebble.h>
+
+#include <stdarg.h>
+#include <sys/stat.h>
+
+#undef time
+#undef localtime
+#undef malloc
+#undef free
+
+#ifndef RESOURCES_DIR
+#define RESOURCES_DIR "../resources"
+#endif
+
+// The framebuffer is 8-bit on every platform, black and white ones included
+#define SCREEN_WIDTH PBL_DISPLAY_WIDTH
+#define SCREEN_HEIGHT PBL_DISPLAY_HEIGHT
+
+// Rough relative cost of each kind of work, in arbitrary energy units. A CPU
+// wakeup is the fixed price of leaving sleep, a redraw repaints the whole
+// window however little was marked dirty, and a Bluetooth message is by far
+// the most expensive
+#define COST_WAKEUP 50.0
+#define COST_FLASH_READ 5.0
+#define COST_FLASH_BYTE 0.05
+#define COST_RENDER 50.0
+#define COST_GLYPH 2.0
+#define COST_MESSAGE 2000.0
+#define COST_ACCEL_SAMPLE 0.5
+
+// Rough time each kind of work keeps the watch busy, in microseconds. Only
+// used for the time from launch to the first frame, and just as much a guess
+// as the COST_* weights
+#define BUSY_FLASH_READ 100.0
+#define BUSY_FLASH_BYTE 0.1
+#define BUSY_PNG_BYTE 0.5
+#define BUSY_FONT_LOAD 2000.0
+#define BUSY_GLYPH 30.0
+#define BUSY_RENDER_PIXEL 0.01
+#define BUSY_MESSAGE_OPEN 3000.0
+
+static double busyUs;
+
+// Busy time, reads and glyphs from each launch to its first frame
+#define MAX_LAUNCHES 2
+
+typedef struct Launch {
+  uint64_t at;
+  double busyUs;
+  unsigned long flashReads;
+  unsigned long glyphs;
+} Launch;
+
+static Launch launches[MAX_LAUNCHES];
+static int launchCount;
+static bool awaitingFirstFrame;
+
+int pebble_main(void);
+
+// Options
+
+static struct {
+  int hours;
+  int startMinute;
+  const char *bedtime;
+  const char *getUpTime;
+  bool batterySaver;
+  bool wristPause;
+  bool caughtYou;
+  int glances;
+  int borises;
+  int batteryStart;
+  int batteryEnd;
+  unsigned seed;
+  bool verbose;
+  int awayFrom;
+  int awayUntil;
+  int clockFrom;
+  int clockTo;
+} options = {
+  .hours = 24,
+  .startMinute = 12 * 60,
+  .bedtime = "22:00",
+  .getUpTime = "08:00",
+  .batteryStart = 100,
+  .batteryEnd = 100,
+  .glances = 12,
+  .borises = 1,
+  .seed = 1,
+  .awayFrom = -1,
+  .awayUntil = -1,
+  .clockFrom = -1,
+  .clockTo = -1
+};
+
+// Statistics
+
+typedef struct Stats {
+  double ms;
+  unsigned long wakeups;
+  unsigned long flashReads;
+  double flashBytes;
+  unsigned long renders;
+  double dirtyPixels;
+  unsigned long glyphs;
+  unsigned long messages;
+  unsigned long accelSamples;
+} Stats;
+
+static Stats totalStats;
+static Stats behavStats[HOST_RESOURCE_COUNT + 1];
+static Stats *hourStats;
+static uint32_t curResource;
+
+static double energy(const Stats *stats) {
+  return stats->wakeups * COST_WAKEUP + stats->flashReads * COST_FLASH_READ +
+         stats->flashBytes * COST_FLASH_BYTE +
+         stats->renders * COST_RENDER + stats->glyphs * COST_GLYPH +
+         stats->messages * COST_MESSAGE + stats->accelSamples * COST_ACCEL_SAMPLE;
+}
+
+// Virtual clock, starts at midnight on an arbitrary day
+
+#define EPOCH_MS 1477180800000ULL
+static uint64_t nowMs;
+static uint64_t endMs;
+// What the watch's clock is ahead of the virtual clock, moved by --set-clock.
+// Timers and the report run on the virtual clock
+static int64_t clockOffsetMs;
+
+static uint64_t wallMs(void) {
+  return nowMs + clockOffsetMs;
+}
+
+static int curHour(void) {
+  return (int)((nowMs - EPOCH_MS - options.startMinute * 60000ULL) / 3600000ULL);
+}
+
+static Stats *statsTargets(Stats **targets) {
+  targets[0] = &totalStats;
+  targets[1] = &behavStats[curResource];
+  int hour = curHour();
+  targets[2] = hour < options.hours ? &hourStats[hour] : &totalStats;
+  return targets[0];
+}
+
+#define COUNT(field, amount) do { \
+    Stats *targets[3]; \
+    statsTargets(targets); \
+    targets[0]->field += (amount); \
+    targets[1]->field += (amount); \
+    if(targets[2] != targets[0]) { \
+      targets[2]->field += (amount); \
+    } \
+  } while(0)
+
+static void advanceClock(uint64_t to) {
+  while(nowMs < to) {
+    // Attribute time hour by hour so the per-hour table adds up
+    uint64_t hourEnd = EPOCH_MS + options.startMinute * 60000ULL + (curHour() + 1) * 3600000ULL;
+    uint64_t step = (to < hourEnd ? to : hourEnd) - nowMs;
+    COUNT(ms, (double)step);
+    nowMs += step;
+  }
+}
+
+time_t host_time(time_t *tloc) {
+  time_t t = (time_t)(wallMs() / 1000);
+  if(tloc != NULL) {
+    *tloc = t;
+  }
+  return t;
+}
+
+struct tm *host_localtime(const time_t *timep) {
+  static struct tm result;
+  gmtime_r(timep, &result);
+  return &result;
+}
+
+uint16_t time_ms(time_t *t_utc, uint16_t *out_ms) {
+  uint16_t ms = (uint16_t)(wallMs() % 1000);
+  if(t_utc != NULL) {
+    *t_utc = (time_t)(wallMs() / 1000);
+  }
+  if(out_ms != NULL) {
+    *out_ms = ms;
+  }
+  return ms;
+}
+
+// Heap accounting for the objects the SDK would allocate on the app heap
+
+#define HEAP_SIZE (64 * 1024)
+static size_t heapUsed;
+static size_t heapPeak;
+
+static void *hostAlloc(size_t size) {
+  size_t *block = calloc(1, sizeof(size_t) + size);
+  block[0] = size;
+  heapUsed += size;
+  if(heapUsed > heapPeak) {
+    heapPeak = heapUsed;
+  }
+  return block + 1;
+}
+
+static void hostFree(void *ptr) {
+  if(ptr != NULL) {
+    size_t *block = (size_t *)ptr - 1;
+    heapUsed -= block[0];
+    free(block);
+  }
+}
+
+void *host_malloc(size_t size) {
+  return hostAlloc(size);
+}
+
+void host_free(void *ptr) {
+  hostFree(ptr);
+}
+
+size_t heap_bytes_used(void) {
+  return heapUsed;
+}
+
+size_t heap_bytes_free(void) {
+  return heapUsed < HEAP_SIZE ? HEAP_SIZE - heapUsed : 0;
+}
+
+// Logging
+
+void app_log(uint8_t level, const char *filename, int line, const char *fmt, ...) {
+  if(!options.verbose && level > APP_LOG_LEVEL_WARNING) {
+    return;
+  }
+  va_list args;
+  va_start(args, fmt);
+  fprintf(stderr, "[%02d:%02d] %s:%d ", (int)(wallMs() / 3600000ULL % 24), (int)(wallMs() / 60000ULL % 60),
+          filename, line);
+  vfprintf(stderr, fmt, args);
+  fputc('\n', stderr);
+  va_end(args);
+}
+
+// Resources
+
+static const char *resourcePath(uint32_t id) {
+  static char path[512];
+  if(id == 0 || id > HOST_RESOURCE_COUNT) {
+    fprintf(stderr, "Unknown resource id %u\n", id);
+    exit(1);
+  }
+  snprintf(path, sizeof(path), "%s/%s", RESOURCES_DIR, host_resource_files[id]);
+#if defined(PBL_BW)
+  // Use the ~bw variant if there is one, like the SDK does
+  char *ext = strrchr(path, '.');
+  if(ext != NULL) {
+    char variant[512];
+    struct stat st;
+    snprintf(variant, sizeof(variant), "%.*s~bw%s", (int)(ext - path), path, ext);
+    if(stat(variant, &st) == 0) {
+      snprintf(path, sizeof(path), "%s", variant);
+    }
+  }
+#endif
+  return path;
+}
+
+ResHandle resource_get_handle(uint32_t resource_id) {
+  return (ResHandle)(uintptr_t)resource_id;
+}
+
+size_t resource_size(ResHandle h) {
+  struct stat st;
+  if(stat(resourcePath((uint32_t)(uintptr_t)h), &st) != 0) {
+    return 0;
+  }
+  return (size_t)st.st_size;
+}
+
+static size_t readResource(uint32_t id, uint32_t start_offset, uint8_t *buffer, size_t num_bytes) {
+  FILE *f = fopen(resourcePath(id), "rb");
+  if(f == NULL) {
+    return 0;
+  }
+  fseek(f, start_offset, SEEK_SET);
+  size_t read = fread(buffer, 1, num_bytes, f);
+  fclose(f);
+  return read;
+}
+
+// Reads made by the watchface are counted, and the work that follows is
+// attributed to the resource read last
+size_t resource_load_byte_range(ResHandle h, uint32_t start_offset, uint8_t *buffer, size_t num_bytes) {
+  uint32_t id = (uint32_t)(uintptr_t)h;
+  size_t read = readResource(id, start_offset, buffer, num_bytes);
+  curResource = id;
+  COUNT(flashReads, 1);
+  COUNT(flashBytes, (double)read);
+  busyUs += BUSY_FLASH_READ + read * BUSY_FLASH_BYTE;
+  return read;
+}
+
+size_t resource_load(ResHandle h, uint8_t *buffer, size_t max_length) {
+  return resource_load_byte_range(h, 0, buffer, max_length);
+}
+
+static uint8_t *loadWholeResource(uint32_t id, size_t *size) {
+  *size = resource_size(resource_get_handle(id));
+  uint8_t *data = malloc(*size ? *size : 1);
+  *size = readResource(id, 0, data, *size);
+  return data;
+}
+
+static uint32_t be32(const uint8_t *p) {
+  return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+}
+
+// Bitmaps
+
+struct GBitmap {
+  uint8_t *data;
+  uint16_t rowBytes;
+  GRect bounds;
+  GBitmapFormat format;
+  GColor *palette;
+  bool ownsData;
+  bool ownsPalette;
+};
+
+static GRect clipRect(GRect rect, GRect clip);
+
+static uint16_t rowBytesFor(GBitmapFormat format, int16_t width) {
+  switch(format) {
+    case GBitmapFormat1Bit:
+      return (uint16_t)((width + 31) / 32 * 4);
+    case GBitmapFormat1BitPalette:
+      return (uint16_t)((width + 7) / 8);
+    case GBitmapFormat2BitPalette:
+      return (uint16_t)((width + 3) / 4);
+    case GBitmapFormat4BitPalette:
+      return (uint16_t)((width + 1) / 2);
+    default:
+      return (uint16_t)width;
+  }
+}
+
+static int paletteSize(GBitmapFormat format) {
+  switch(format) {
+    case GBitmapFormat1BitPalette:
+      return 2;
+    case GBitmapFormat2BitPalette:
+      return 4;
+    case GBitmapFormat4BitPalette:
+      return 16;
+    default:
+      return 0;
+  }
+}
+
+static GBitmap *createBitmap(GSize size, GBitmapFormat format) {
+  GBitmap *bitmap = hostAlloc(sizeof(GBitmap));
+  bitmap->format = format;
+  bitmap->bounds = GRect(0, 0, size.w, size.h);
+  bitmap->rowBytes = rowBytesFor(format, size.w);
+  bitmap->data = hostAlloc((size_t)bitmap->rowBytes * (size.h > 0 ? size.h : 1));
+  bitmap->ownsData = true;
+  return bitmap;
+}
+
+GBitmap *gbitmap_create_blank(GSize size, GBitmapFormat format) {
+  GBitmap *bitmap = createBitmap(size, format);
+  if(paletteSize(format) > 0) {
+    bitmap->palette = hostAlloc(paletteSize(format) * sizeof(GColor));
+    bitmap->ownsPalette = true;
+  }
+  return bitmap;
+}
+
+GBitmap *gbitmap_create_blank_with_palette(GSize size, GBitmapFormat format, GColor *palette,
+                                           bool free_on_destroy) {
+  GBitmap *bitmap = createBitmap(size, format);
+  bitmap->palette = palette;
+  bitmap->ownsPalette = free_on_destroy;
+  return bitmap;
+}
+
+// Bitmap resources are loaded at their real size and palette depth, but the
+// pixels themselves are left blank
+GBitmap *gbitmap_create_with_resource(uint32_t resource_id) {
+  size_t size;
+  uint8_t *png = loadWholeResource(resource_id, &size);
+  COUNT(flashReads, 1);
+  COUNT(flashBytes, (double)size);
+  busyUs += BUSY_FLASH_READ + size * (BUSY_FLASH_BYTE + BUSY_PNG_BYTE);
+  GSize dims = GSize(0, 0);
+  int colors = 256;
+  for(size_t pos = 8; pos + 8 <= size; pos += 12 + be32(png + pos)) {
+    if(!memcmp(png + pos + 4, "IHDR", 4)) {
+      dims = GSize((int16_t)be32(png + pos + 8), (int16_t)be32(png + pos + 12));
+    } else if(!memcmp(png + pos + 4, "PLTE", 4)) {
+      colors = (int)(be32(png + pos) / 3);
+    }
+  }
+  free(png);
+  GBitmapFormat format = colors <= 2 ? GBitmapFormat1BitPalette :
+                         colors <= 4 ? GBitmapFormat2BitPalette :
+                         colors <= 16 ? GBitmapFormat4BitPalette : GBitmapFormat8Bit;
+  return gbitmap_create_blank(dims, format);
+}
+
+GBitmap *gbitmap_create_as_sub_bitmap(const GBitmap *base_bitmap, GRect sub_rect) {
+  GBitmap *bitmap = hostAlloc(sizeof(GBitmap));
+  *bitmap = *base_bitmap;
+  bitmap->bounds = sub_rect;
+  bitmap->ownsData = false;
+  bitmap->ownsPalette = false;
+  return bitmap;
+}
+
+void gbitmap_destroy(GBitmap *bitmap) {
+  if(bitmap == NULL) {
+    return;
+  }
+  if(bitmap->ownsData) {
+    hostFree(bitmap->data);
+  }
+  if(bitmap->ownsPalette) {
+    hostFree(bitmap->palette);
+  }
+  hostFree(bitmap);
+}
+
+uint8_t *gbitmap_get_data(const GBitmap *bitmap) {
+  return bitmap->data;
+}
+
+uint16_t gbitmap_get_bytes_per_row(const GBitmap *bitmap) {
+  return bitmap->rowBytes;
+}
+
+GRect gbitmap_get_bounds(const GBitmap *bitmap) {
+  return bitmap->bounds;
+}
+
+void gbitmap_set_bounds(GBitmap *bitmap, GRect bounds) {
+  bitmap->bounds = bounds;
+}
+
+GBitmapFormat gbitmap_get_format(const GBitmap *bitmap) {
+  return bitmap->format;
+}
+
+GColor *gbitmap_get_palette(const GBitmap *bitmap) {
+  return bitmap->palette;
+}
+
+void gbitmap_set_palette(GBitmap *bitmap, GColor *palette, bool free_on_destroy) {
+  if(bitmap->ownsPalette) {
+    hostFree(bitmap->palette);
+  }
+  bitmap->palette = palette;
+  bitmap->ownsPalette = free_on_destroy;
+}
+
+GBitmapDataRowInfo gbitmap_get_data_row_info(const GBitmap *bitmap, uint16_t y) {
+  return (GBitmapDataRowInfo) {
+    .data = bitmap->data + (size_t)y * bitmap->rowBytes,
+    .min_x = 0,
+    .max_x = (int16_t)(bitmap->bounds.size.w - 1)
+  };
+}
+
+static GColor bitmapPixel(const GBitmap *bitmap, int x, int y) {
+  const uint8_t *row = bitmap->data + (size_t)y * bitmap->rowBytes;
+  switch(bitmap->format) {
+    case GBitmapFormat8Bit:
+    case GBitmapFormat8BitCircular:
+      return (GColor){ .argb = row[x] };
+    case GBitmapFormat1Bit:
+      return (row[x / 8] >> (x % 8)) & 1 ? GColorWhite : GColorBlack;
+    default: {
+      int bits = bitmap->format == GBitmapFormat1BitPalette ? 1 :
+                 bitmap->format == GBitmapFormat2BitPalette ? 2 : 4;
+      int perByte = 8 / bits;
+      int shift = (perByte - 1 - x % perByte) * bits;
+      return bitmap->palette[(row[x / perByte] >> shift) & ((1 << bits) - 1)];
+    }
+  }
+}
+
+bool grect_equal(const GRect *rect_a, const GRect *rect_b) {
+  return !memcmp(rect_a, rect_b, sizeof(GRect));
+}
+
+bool gsize_equal(const GSize *size_a, const GSize *size_b) {
+  return size_a->w == size_b->w && size_a->h == size_b->h;
+}
+
+void grect_clip(GRect *const rect_to_clip, const GRect *const rect_clipper) {
+  *rect_to_clip = clipRect(*rect_to_clip, *rect_clipper);
+}
+
+// Fonts only carry their pixel height, taken from the resource name
+
+struct GFontHost {
+  int height;
+};
+
+GFont fonts_load_custom_font(ResHandle handle) {
+  GFont font = hostAlloc(sizeof(struct GFontHost));
+  const char *name = host_resource_names[(uint32_t)(uintptr_t)handle];
+  const char *digits = strpbrk(name, "0123456789");
+  font->height = digits != NULL ? atoi(digits) : 14;
+  // Custom fonts keep their glyph cache on the heap
+  heapUsed += 2048;
+  busyUs += BUSY_FONT_LOAD;
+  return font;
+}
+
+void fonts_unload_custom_font(GFont font) {
+  heapUsed -= 2048;
+  hostFree(font);
+}
+
+GFont fonts_get_system_font(const char *font_key) {
+  static struct GFontHost fonts[2] = { { 14 }, { 18 } };
+  return strstr(font_key, "18") ? &fonts[1] : &fonts[0];
+}
+
+// Layers and drawing
+
+enum { LAYER_PLAIN, LAYER_TEXT, LAYER_BITMAP };
+
+struct Layer {
+  GRect frame;
+  GRect bounds;
+  LayerUpdateProc updateProc;
+  Layer *parent;
+  Layer *children;
+  Layer *next;
+  bool hidden;
+  int kind;
+  void *data;
+};
+
+struct TextLayer {
+  Layer layer;
+  const char *text;
+  GColor background;
+  GColor color;
+  GFont font;
+  GTextAlignment alignment;
+};
+
+struct BitmapLayer {
+  Layer layer;
+  const GBitmap *bitmap;
+  GCompOp mode;
+};
+
+struct Window {
+  Layer root;
+  WindowHandlers handlers;
+  GColor background;
+  bool loaded;
+};
+
+struct GContext {
+  GBitmap *framebuffer;
+  GPoint offset;
+  GRect clip;
+  GColor fill;
+  GColor stroke;
+  GColor text;
+  GCompOp mode;
+  bool captured;
+};
+
+static Window *topWindow;
+static GBitmap *framebuffer;
+static GRect dirtyRect;
+static bool renderPending;
+
+static void initLayer(Layer *layer, GRect frame, int kind) {
+  layer->frame = frame;
+  layer->bounds = GRect(0, 0, frame.size.w, frame.size.h);
+  layer->kind = kind;
+}
+
+Layer *layer_create(GRect frame) {
+  Layer *layer = hostAlloc(sizeof(Layer));
+  initLayer(layer, frame, LAYER_PLAIN);
+  return layer;
+}
+
+Layer *layer_create_with_data(GRect frame, size_t data_size) {
+  Layer *layer = layer_create(frame);
+  layer->data = hostAlloc(data_size);
+  return layer;
+}
+
+void *layer_get_data(const Layer *layer) {
+  return layer->data;
+}
+
+void layer_remove_from_parent(Layer *child) {
+  if(child->parent == NULL) {
+    return;
+  }
+  Layer **link = &child->parent->children;
+  while(*link != child) {
+    link = &(*link)->next;
+  }
+  *link = child->next;
+  child->parent = NULL;
+  child->next = NULL;
+}
+
+void layer_destroy(Layer *layer) {
+  if(layer == NULL) {
+    return;
+  }
+  layer_remove_from_parent(layer);
+  hostFree(layer->data);
+  hostFree(layer);
+}
+
+static GRect absoluteFrame(const Layer *layer) {
+  GRect rect = layer->frame;
+  for(const Layer *parent = layer->parent; parent != NULL; parent = parent->parent) {
+    rect.origin.x += parent->frame.origin.x + parent->bounds.origin.x;
+    rect.origin.y += parent->frame.origin.y + parent->bounds.origin.y;
+  }
+  return rect;
+}
+
+static GRect clipRect(GRect rect, GRect clip) {
+  int x0 = rect.origin.x > clip.origin.x ? rect.origin.x : clip.origin.x;
+  int y0 = rect.origin.y > clip.origin.y ? rect.origin.y : clip.origin.y;
+  int x1 = rect.origin.x + rect.size.w;
+  int y1 = rect.origin.y + rect.size.h;
+  if(x1 > clip.origin.x + clip.size.w) {
+    x1 = clip.origin.x + clip.size.w;
+  }
+  if(y1 > clip.origin.y + clip.size.h) {
+    y1 = clip.origin.y + clip.size.h;
+  }
+  if(x1 <= x0 || y1 <= y0) {
+    return GRectZero;
+  }
+  return GRect(x0, y0, x1 - x0, y1 - y0);
+}
+
+static GRect unionRect(GRect a, GRect b) {
+  if(a.size.w <= 0 || a.size.h <= 0) {
+    return b;
+  }
+  if(b.size.w <= 0 || b.size.h <= 0) {
+    return a;
+  }
+  int x0 = a.origin.x < b.origin.x ? a.origin.x : b.origin.x;
+  int y0 = a.origin.y < b.origin.y ? a.origin.y : b.origin.y;
+  int x1 = a.origin.x + a.size.w > b.origin.x + b.size.w ? a.origin.x + a.size.w : b.origin.x + b.size.w;
+  int y1 = a.origin.y + a.size.h > b.origin.y + b.size.h ? a.origin.y + a.size.h : b.origin.y + b.size.h;
+  return GRect(x0, y0, x1 - x0, y1 - y0);
+}
+
+void layer_mark_dirty(Layer *layer) {
+  GRect screen = GRect(0, 0, SCREEN_WIDTH, SCREEN_HEIGHT);
+  dirtyRect = unionRect(dirtyRect, clipRect(absoluteFrame(layer), screen));
+  renderPending = true;
+}
+
+void layer_set_update_proc(Layer *layer, LayerUpdateProc update_proc) {
+  layer->updateProc = update_proc;
+}
+
+void layer_set_frame(Layer *layer, GRect frame) {
+  if(grect_equal(&layer->frame, &frame)) {
+    return;
+  }
+  // Moving a layer invalidates both where it was and where it is now
+  layer_mark_dirty(layer);
+  layer->frame = frame;
+  layer->bounds.size = frame.size;
+  layer_mark_dirty(layer);
+}
+
+GRect layer_get_frame(const Layer *layer) {
+  return layer->frame;
+}
+
+void layer_set_bounds(Layer *layer, GRect bounds) {
+  layer->bounds = bounds;
+  layer_mark_dirty(layer);
+}
+
+GRect layer_get_bounds(const Layer *layer) {
+  return layer->bounds;
+}
+
+void layer_add_child(Layer *parent, Layer *child) {
+  layer_remove_from_parent(child);
+  Layer **link = &parent->children;
+  while(*link != NULL) {
+    link = &(*link)->next;
+  }
+  *link = child;
+  child->parent = parent;
+  layer_mark_dirty(child);
+}
+
+void layer_set_hidden(Layer *layer, bool hidden) {
+  if(layer->hidden != hidden) {
+    layer->hidden = hidden;
+    layer_mark_dirty(layer);
+  }
+}
+
+bool layer_get_hidden(const Layer *layer) {
+  return layer->hidden;
+}
+
+TextLayer *text_layer_create(GRect frame) {
+  TextLayer *text_layer = hostAlloc(sizeof(TextLayer));
+  initLayer(&text_layer->layer, frame, LAYER_TEXT);
+  text_layer->background = GColorWhite;
+  text_layer->color = GColorBlack;
+  text_layer->font = fonts_get_system_font(FONT_KEY_GOTHIC_14);
+  return text_layer;
+}
+
+void text_layer_destroy(TextLayer *text_layer) {
+  if(text_layer != NULL) {
+    layer_remove_from_parent(&text_layer->layer);
+    hostFree(text_layer);
+  }
+}
+
+Layer *text_layer_get_layer(TextLayer *text_layer) {
+  return &text_layer->layer;
+}
+
+void text_layer_set_text(TextLayer *text_layer, const char *text) {
+  text_layer->text = text;
+  layer_mark_dirty(&text_layer->layer);
+}
+
+const char *text_layer_get_text(TextLayer *text_layer) {
+  return text_layer->text;
+}
+
+void text_layer_set_background_color(TextLayer *text_layer, GColor color) {
+  text_layer->background = color;
+}
+
+void text_layer_set_text_color(TextLayer *text_layer, GColor color) {
+  text_layer->color = color;
+}
+
+void text_layer_set_font(TextLayer *text_layer, GFont font) {
+  text_layer->font = font;
+}
+
+void text_layer_set_text_alignment(TextLayer *text_layer, GTextAlignment text_alignment) {
+  text_layer->alignment = text_alignment;
+}
+
+BitmapLayer *bitmap_layer_create(GRect frame) {
+  BitmapLayer *bitmap_layer = hostAlloc(sizeof(BitmapLayer));
+  initLayer(&bitmap_layer->layer, frame, LAYER_BITMAP);
+  bitmap_layer->mode = GCompOpAssign;
+  return bitmap_layer;
+}
+
+void bitmap_layer_destroy(BitmapLayer *bitmap_layer) {
+  if(bitmap_layer != NULL) {
+    layer_remove_from_parent(&bitmap_layer->layer);
+    hostFree(bitmap_layer);
+  }
+}
+
+Layer *bitmap_layer_get_layer(const BitmapLayer *bitmap_layer) {
+  return (Layer *)&bitmap_layer->layer;
+}
+
+void bitmap_layer_set_bitmap(BitmapLayer *bitmap_layer, const GBitmap *bitmap) {
+  bitmap_layer->bitmap = bitmap;
+  layer_mark_dirty(&bitmap_layer->layer);
+}
+
+void bitmap_layer_set_compositing_mode(BitmapLayer *bitmap_layer, GCompOp mode) {
+  bitmap_layer->mode = mode;
+}
+
+void graphics_context_set_fill_color(GContext *ctx, GColor color) {
+  ctx->fill = color;
+}
+
+void graphics_context_set_stroke_color(GContext *ctx, GColor color) {
+  ctx->stroke = color;
+}
+
+void graphics_context_set_text_color(GContext *ctx, GColor color) {
+  ctx->text = color;
+}
+
+void graphics_context_set_compositing_mode(GContext *ctx, GCompOp mode) {
+  ctx->mode = mode;
+}
+
+static GRect toScreen(GContext *ctx, GRect rect) {
+  rect.origin.x += ctx->offset.x;
+  rect.origin.y += ctx->offset.y;
+  return clipRect(rect, ctx->clip);
+}
+
+void graphics_fill_rect(GContext *ctx, GRect rect, uint16_t corner_radius, GCornerMask corner_mask) {
+  GRect area = toScreen(ctx, rect);
+  if(ctx->fill.a == 0) {
+    return;
+  }
+  for(int y = area.origin.y; y < area.origin.y + area.size.h; y++) {
+    memset(ctx->framebuffer->data + y * ctx->framebuffer->rowBytes + area.origin.x, ctx->fill.argb,
+           area.size.w);
+  }
+}
+
+void graphics_draw_bitmap_in_rect(GContext *ctx, const GBitmap *bitmap, GRect rect) {
+  if(bitmap == NULL) {
+    return;
+  }
+  GRect area = toScreen(ctx, rect);
+  int dx = rect.origin.x + ctx->offset.x;
+  int dy = rect.origin.y + ctx->offset.y;
+  for(int y = area.origin.y; y < area.origin.y + area.size.h; y++) {
+    int sy = bitmap->bounds.origin.y + (y - dy) % bitmap->bounds.size.h;
+    for(int x = area.origin.x; x < area.origin.x + area.size.w; x++) {
+      int sx = bitmap->bounds.origin.x + (x - dx) % bitmap->bounds.size.w;
+      GColor color = bitmapPixel(bitmap, sx, sy);
+      if(ctx->mode == GCompOpSet && color.a == 0) {
+        continue;
+      }
+      ctx->framebuffer->data[y * ctx->framebuffer->rowBytes + x] = color.argb | 0xC0;
+    }
+  }
+}
+
+static unsigned long countGlyphs(const char *text) {
+  unsigned long glyphs = 0;
+  for(; text != NULL && *text; text++) {
+    if(*text != ' ') {
+      glyphs++;
+    }
+  }
+  return glyphs;
+}
+
+GSize graphics_text_layout_get_content_size(const char *text, GFont const font, const GRect box,
+                                            const GTextOverflowMode overflow_mode,
+                                            const GTextAlignment alignment) {
+  int width = (int)(strlen(text) * font->height / 2);
+  return GSize(width < box.size.w ? width : box.size.w, font->height * 6 / 5);
+}
+
+// Text isn't rasterized, each glyph is drawn as a solid block of its cell
+void graphics_draw_text(GContext *ctx, const char *text, GFont const font, const GRect box,
+                        const GTextOverflowMode overflow_mode, const GTextAlignment alignment,
+                        GTextAttributes *text_attributes) {
+  COUNT(glyphs, countGlyphs(text));
+  busyUs += countGlyphs(text) * BUSY_GLYPH;
+  GColor fill = ctx->fill;
+  ctx->fill = ctx->text;
+  int cell = font->height / 2;
+  int x = box.origin.x;
+  for(; *text; text++, x += cell) {
+    if(*text != ' ') {
+      graphics_fill_rect(ctx, GRect(x + 1, box.origin.y + font->height / 4, cell - 2, font->height * 3 / 4),
+                         0, GCornerNone);
+    }
+  }
+  ctx->fill = fill;
+}
+
+GBitmap *graphics_capture_frame_buffer(GContext *ctx) {
+  if(ctx->captured) {
+    return NULL;
+  }
+  ctx->captured = true;
+  return ctx->framebuffer;
+}
+
+GBitmap *graphics_capture_frame_buffer_format(GContext *ctx, GBitmapFormat format) {
+  return graphics_capture_frame_buffer(ctx);
+}
+
+bool graphics_release_frame_buffer(GContext *ctx, GBitmap *buffer) {
+  bool captured = ctx->captured;
+  ctx->captured = false;
+  return captured;
+}
+
+static void renderLayer(GContext *ctx, Layer *layer, GPoint origin, GRect clip) {
+  if(layer->hidden) {
+    return;
+  }
+  GRect frame = layer->frame;
+  frame.origin.x += origin.x;
+  frame.origin.y += origin.y;
+  ctx->clip = clipRect(frame, clip);
+  ctx->offset = GPoint(frame.origin.x + layer->bounds.origin.x, frame.origin.y + layer->bounds.origin.y);
+  if(layer->kind == LAYER_TEXT) {
+    TextLayer *text_layer = (TextLayer *)layer;
+    ctx->fill = text_layer->background;
+    graphics_fill_rect(ctx, layer->bounds, 0, GCornerNone);
+    if(text_layer->text != NULL) {
+      ctx->text = text_layer->color;
+      graphics_draw_text(ctx, text_layer->text, text_layer->font, layer->bounds,
+                         GTextOverflowModeWordWrap, text_layer->alignment, NULL);
+    }
+  } else if(layer->kind == LAYER_BITMAP) {
+    BitmapLayer *bitmap_layer = (BitmapLayer *)layer;
+    ctx->mode = bitmap_layer->mode;
+    if(bitmap_layer->bitmap != NULL) {
+      GRect bounds = bitmap_layer->bitmap->bounds;
+      graphics_draw_bitmap_in_rect(ctx, bitmap_layer->bitmap, GRect(0, 0, bounds.size.w, bounds.size.h));
+    }
+  }
+  if(layer->updateProc != NULL) {
+    ctx->mode = GCompOpAssign;
+    layer->updateProc(layer, ctx);
+  }
+  GPoint childOrigin = ctx->offset;
+  GRect childClip = ctx->clip;
+  for(Layer *child = layer->children; child != NULL; child = child->next) {
+    renderLayer(ctx, child, childOrigin, childClip);
+  }
+}
+
+// The firmware redraws the whole window, the dirty area is tracked to show
+// how much of the screen actually changed
+static void render(void) {
+  if(!renderPending || topWindow == NULL) {
+    return;
+  }
+  COUNT(renders, 1);
+  COUNT(dirtyPixels, (double)dirtyRect.size.w * dirtyRect.size.h);
+  GContext ctx = { .framebuffer = framebuffer };
+  memset(framebuffer->data, topWindow->background.argb, (size_t)framebuffer->rowBytes * SCREEN_HEIGHT);
+  renderLayer(&ctx, &topWindow->root, GPointZero, GRect(0, 0, SCREEN_WIDTH, SCREEN_HEIGHT));
+  renderPending = false;
+  dirtyRect = GRectZero;
+  busyUs += SCREEN_WIDTH * SCREEN_HEIGHT * BUSY_RENDER_PIXEL;
+  if(awaitingFirstFrame) {
+    Launch *launch = &launches[launchCount - 1];
+    launch->busyUs = busyUs;
+    launch->flashReads = totalStats.flashReads - launch->flashReads;
+    launch->glyphs = totalStats.glyphs - launch->glyphs;
+    awaitingFirstFrame = false;
+  }
+}
+
+// Windows
+
+Window *window_create(void) {
+  Window *window = hostAlloc(sizeof(Window));
+  initLayer(&window->root, GRect(0, 0, SCREEN_WIDTH, SCREEN_HEIGHT), LAYER_PLAIN);
+  window->background = GColorWhite;
+  return window;
+}
+
+void window_destroy(Window *window) {
+  if(window == NULL) {
+    return;
+  }
+  if(window->loaded && window->handlers.unload != NULL) {
+    window->handlers.unload(window);
+  }
+  if(topWindow == window) {
+    topWindow = NULL;
+  }
+  hostFree(window);
+}
+
+void window_set_window_handlers(Window *window, WindowHandlers handlers) {
+  window->handlers = handlers;
+}
+
+Layer *window_get_root_layer(const Window *window) {
+  return (Layer *)&window->root;
+}
+
+void window_set_background_color(Window *window, GColor background_color) {
+  window->background = background_color;
+  layer_mark_dirty(&window->root);
+}
+
+void window_stack_push(Window *window, bool animated) {
+  topWindow = window;
+  if(!window->loaded && window->handlers.load != NULL) {
+    window->handlers.load(window);
+  }
+  window->loaded = true;
+  if(window->handlers.appear != NULL) {
+    window->handlers.appear(window);
+  }
+  layer_mark_dirty(&window->root);
+}
+
+// Timers
+
+#define MAX_TIMERS 64
+
+typedef struct HostTimer {
+  uintptr_t id;
+  uint64_t due;
+  AppTimerCallback callback;
+  void *data;
+} HostTimer;
+
+static HostTimer timers[MAX_TIMERS];
+static uintptr_t nextTimerId = 1;
+
+static HostTimer *findTimer(AppTimer *handle) {
+  for(int i = 0; i < MAX_TIMERS; i++) {
+    if(timers[i].id != 0 && timers[i].id == (uintptr_t)handle) {
+      return &timers[i];
+    }
+  }
+  return NULL;
+}
+
+AppTimer *app_timer_register(uint32_t timeout_ms, AppTimerCallback callback, void *callback_data) {
+  for(int i = 0; i < MAX_TIMERS; i++) {
+    if(timers[i].id == 0) {
+      timers[i] = (HostTimer){ nextTimerId++, nowMs + timeout_ms, callback, callback_data };
+      return (AppTimer *)timers[i].id;
+    }
+  }
+  fprintf(stderr, "Out of timers\n");
+  exit(1);
+}
+
+bool app_timer_reschedule(AppTimer *timer_handle, uint32_t new_timeout_ms) {
+  HostTimer *timer = findTimer(timer_handle);
+  if(timer == NULL) {
+    return false;
+  }
+  timer->due = nowMs + new_timeout_ms;
+  return true;
+}
+
+void app_timer_cancel(AppTimer *timer_handle) {
+  HostTimer *timer = findTimer(timer_handle);
+  if(timer != NULL) {
+    timer->id = 0;
+  }
+}
+
+static HostTimer *nextTimer(void) {
+  HostTimer *next = NULL;
+  for(int i = 0; i < MAX_TIMERS; i++) {
+    if(timers[i].id != 0 && (next == NULL || timers[i].due < next->due ||
+                             (timers[i].due == next->due && timers[i].id < next->id))) {
+      next = &timers[i];
+    }
+  }
+  return next;
+}
+
+static TickHandler tickHandler;
+static TimeUnits tickUnits;
+
+void tick_timer_service_subscribe(TimeUnits tick_units, TickHandler handler) {
+  tickHandler = handler;
+  tickUnits = tick_units;
+}
+
+void tick_timer_service_unsubscribe(void) {
+  tickHandler = NULL;
+}
+
+// Battery, drains linearly between the configured levels in 10% steps
+
+static BatteryStateHandler batteryHandler;
+static uint8_t batteryReported;
+
+void battery_state_service_subscribe(BatteryStateHandler handler) {
+  batteryHandler = handler;
+}
+
+void battery_state_service_unsubscribe(void) {
+  batteryHandler = NULL;
+}
+
+BatteryChargeState battery_state_service_peek(void) {
+  double done = (double)(nowMs - (endMs - options.hours * 3600000ULL)) / (options.hours * 3600000.0);
+  int level = options.batteryStart + (int)((options.batteryEnd - options.batteryStart) * done);
+  level = (level + 5) / 10 * 10;
+  if(level < 0) {
+    level = 0;
+  }
+  return (BatteryChargeState){ .charge_percent = (uint8_t)(level > 100 ? 100 : level) };
+}
+
+// Accelerometer. The wearer glances at the watch options.glances times an
+// hour at random moments: a flick of the wrist, which the tap service
+// reports, then GLANCE_MS of arm motion. The rest of the time the watch lies
+// still and face up. The simulator has its own random numbers so the
+// watchface's rand() sequence is the same with or without glances
+
+#define GLANCE_MS 8000
+
+static AccelDataHandler accelHandler;
+static uint32_t accelBatch;
+static uint32_t accelRate = ACCEL_SAMPLING_25HZ;
+static uint64_t accelDue;
+static AccelTapHandler tapHandler;
+static uint64_t glanceDue;
+static uint64_t glanceFrom;
+static uint64_t glanceUntil;
+static uint32_t hostSeed;
+
+static uint32_t hostRandom(void) {
+  hostSeed = hostSeed * 1103515245 + 12345;
+  return hostSeed >> 8;
+}
+
+static uint64_t accelPeriod(void) {
+  return accelBatch * 1000ULL / accelRate;
+}
+
+static void nextGlance(void) {
+  glanceDue = options.glances > 0 ? nowMs + GLANCE_MS + hostRandom() % (2 * 3600000U / options.glances) : UINT64_MAX;
+}
+
+void accel_data_service_subscribe(uint32_t samples_per_update, AccelDataHandler handler) {
+  accelHandler = handler;
+  accelBatch = samples_per_update > 0 ? samples_per_update : 1;
+  accelDue = nowMs + accelPeriod();
+}
+
+void accel_data_service_unsubscribe(void) {
+  accelHandler = NULL;
+}
+
+int accel_service_set_sampling_rate(AccelSamplingRate rate) {
+  accelRate = rate;
+  accelDue = nowMs + accelPeriod();
+  return 0;
+}
+
+void accel_tap_service_subscribe(AccelTapHandler handler) {
+  tapHandler = handler;
+  nextGlance();
+}
+
+void accel_tap_service_unsubscribe(void) {
+  tapHandler = NULL;
+}
+
+// A batch of the samples taken since the last one, in mG
+static void sendAccelBatch(void) {
+  AccelData samples[accelBatch];
+  for(uint32_t i = 0; i < accelBatch; i++) {
+    uint64_t at = nowMs - (accelBatch - 1 - i) * 1000ULL / accelRate;
+    int swing = at >= glanceFrom && at < glanceUntil ? 400 : 16;
+    samples[i] = (AccelData){
+      .x = (int16_t)((int)(hostRandom() % swing) - swing / 2),
+      .y = (int16_t)((int)(hostRandom() % swing) - swing / 2),
+      .z = (int16_t)(-1000 + (int)(hostRandom() % swing) - swing / 2),
+      .timestamp = at
+    };
+  }
+  COUNT(accelSamples, accelBatch);
+  accelDue = nowMs + accelPeriod();
+  accelHandler(samples, accelBatch);
+}
+
+static void startGlance(void) {
+  glanceFrom = nowMs;
+  glanceUntil = nowMs + GLANCE_MS;
+  nextGlance();
+  if(tapHandler != NULL) {
+    tapHandler(ACCEL_AXIS_Y, 1);
+  }
+}
+
+// Persistent storage
+
+#define MAX_PERSIST 32
+
+typedef struct PersistEntry {
+  bool used;
+  uint32_t key;
+  size_t size;
+  uint8_t data[256];
+} PersistEntry;
+
+static PersistEntry persistStore[MAX_PERSIST];
+
+static PersistEntry *findPersist(uint32_t key, bool create) {
+  PersistEntry *free = NULL;
+  for(int i = 0; i < MAX_PERSIST; i++) {
+    if(persistStore[i].used && persistStore[i].key == key) {
+      return &persistStore[i];
+    }
+    if(!persistStore[i].used && free == NULL) {
+      free = &persistStore[i];
+    }
+  }
+  if(create && free != NULL) {
+    free->used = true;
+    free->key = key;
+    return free;
+  }
+  return NULL;
+}
+
+bool persist_exists(const uint32_t key) {
+  return findPersist(key, false) != NULL;
+}
+
+int persist_read_data(const uint32_t key, void *buffer, const size_t buffer_size) {
+  PersistEntry *entry = findPersist(key, false);
+  if(entry == NULL) {
+    return -1;
+  }
+  size_t size = entry->size < buffer_size ? entry->size : buffer_size;
+  memcpy(buffer, entry->data, size);
+  return (int)size;
+}
+
+int persist_write_data(const uint32_t key, const void *data, const size_t size) {
+  PersistEntry *entry = findPersist(key, true);
+  entry->size = size < sizeof(entry->data) ? size : sizeof(entry->data);
+  memcpy(entry->data, data, entry->size);
+  return (int)entry->size;
+}
+
+int32_t persist_read_int(const uint32_t key) {
+  int32_t value = 0;
+  persist_read_data(key, &value, sizeof(value));
+  return value;
+}
+
+int persist_write_int(const uint32_t key, const int32_t value) {
+  return persist_write_data(key, &value, sizeof(value));
+}
+
+int persist_delete(const uint32_t key) {
+  PersistEntry *entry = findPersist(key, false);
+  if(entry != NULL) {
+    entry->used = false;
+  }
+  return 0;
+}
+
+// Dictionaries and AppMessage
+
+struct DictionaryIterator {
+  uint8_t buffer[512];
+  size_t used;
+};
+
+uint32_t dict_calc_buffer_size(const uint8_t tuple_count, ...) {
+  uint32_t size = 1;
+  va_list sizes;
+  va_start(sizes, tuple_count);
+  for(int i = 0; i < tuple_count; i++) {
+    size += 7 + va_arg(sizes, uint32_t);
+  }
+  va_end(sizes);
+  return size;
+}
+
+Tuple *dict_find(const DictionaryIterator *iter, const uint32_t key) {
+  size_t pos = 0;
+  while(pos < iter->used) {
+    Tuple *tuple = (Tuple *)(iter->buffer + pos);
+    if(tuple->key == key) {
+      return tuple;
+    }
+    pos += sizeof(Tuple) + tuple->length;
+  }
+  return NULL;
+}
+
+static DictionaryResult dictWrite(DictionaryIterator *iter, uint32_t key, TupleType type,
+                                  const void *data, uint16_t size) {
+  if(iter->used + sizeof(Tuple) + size > sizeof(iter->buffer)) {
+    return DICT_NOT_ENOUGH_STORAGE;
+  }
+  Tuple *tuple = (Tuple *)(iter->buffer + iter->used);
+  tuple->key = key;
+  tuple->type = type;
+  tuple->length = size;
+  memcpy(tuple->value, data, size);
+  iter->used += sizeof(Tuple) + size;
+  return DICT_OK;
+}
+
+DictionaryResult dict_write_uint8(DictionaryIterator *iter, const uint32_t key, const uint8_t value) {
+  return dictWrite(iter, key, TUPLE_UINT, &value, sizeof(value));
+}
+
+DictionaryResult dict_write_int32(DictionaryIterator *iter, const uint32_t key, const int32_t value) {
+  return dictWrite(iter, key, TUPLE_INT, &value, sizeof(value));
+}
+
+DictionaryResult dict_write_data(DictionaryIterator *iter, const uint32_t key, const uint8_t *data,
+                                 const uint16_t size) {
+  return dictWrite(iter, key, TUPLE_BYTE_ARRAY, data, size);
+}
+
+static int parseClock(const char *text);
+
+static AppMessageInboxReceived inboxReceived;
+static AppMessageOutboxSent outboxSent;
+static DictionaryIterator outbox;
+static bool outboxOpen;
+// The phone can only send once the watchface has opened AppMessage
+static bool messagingOpen;
+static bool configPending;
+
+AppMessageResult app_message_open(const uint32_t size_inbound, const uint32_t size_outbound) {
+  heapUsed += size_inbound + size_outbound;
+  busyUs += BUSY_MESSAGE_OPEN;
+  messagingOpen = true;
+  return APP_MSG_OK;
+}
+
+AppMessageInboxReceived app_message_register_inbox_received(AppMessageInboxReceived received_callback) {
+  AppMessageInboxReceived old = inboxReceived;
+  inboxReceived = received_callback;
+  return old;
+}
+
+AppMessageInboxDropped app_message_register_inbox_dropped(AppMessageInboxDropped dropped_callback) {
+  return NULL;
+}
+
+AppMessageOutboxSent app_message_register_outbox_sent(AppMessageOutboxSent sent_callback) {
+  AppMessageOutboxSent old = outboxSent;
+  outboxSent = sent_callback;
+  return old;
+}
+
+AppMessageOutboxFailed app_message_register_outbox_failed(AppMessageOutboxFailed failed_callback) {
+  return NULL;
+}
+
+AppMessageResult app_message_outbox_begin(DictionaryIterator **iterator) {
+  if(outboxOpen) {
+    return APP_MSG_BUSY;
+  }
+  outbox.used = 0;
+  outboxOpen = true;
+  *iterator = &outbox;
+  return APP_MSG_OK;
+}
+
+// Packets from the phone, see the PACKET_* layout in main.c. index.js sends
+// a day of forecast at a time
+#define FORECAST_HOURS 24
+
+// Packets from the phone, see the PACKET_* layout in main.c
+static void sendPacket(const uint8_t *data, uint16_t size) {
+  static DictionaryIterator inbox;
+  inbox.used = 0;
+  dict_write_data(&inbox, MESSAGE_KEY_PACKET, data, size);
+  if(inboxReceived != NULL) {
+    inboxReceived(&inbox, NULL);
+  }
+}
+
+AppMessageResult app_message_outbox_send(void) {
+  if(!outboxOpen) {
+    return APP_MSG_BUSY;
+  }
+  outboxOpen = false;
+  COUNT(messages, 1);
+  if(outboxSent != NULL) {
+    outboxSent(&outbox, NULL);
+  }
+  // Answer weather requests the way index.js would, with a day of light rain
+  // from this hour on
+  Tuple *packet = dict_find(&outbox, MESSAGE_KEY_PACKET);
+  if(packet != NULL && packet->length >= 2 && packet->value->data[1] == 1) {
+    uint32_t start = (uint32_t)(wallMs() / 1000 / 3600 * 3600);
+    uint8_t forecast[6 + 2 * FORECAST_HOURS] = { 1, 5, start & 0xff, (start >> 8) & 0xff, (start >> 16) & 0xff,
+                                                 start >> 24 };
+    for(int i = 0; i < FORECAST_HOURS; i++) {
+      forecast[6 + 2 * i] = 12;
+      forecast[7 + 2 * i] = 10;
+    }
+    sendPacket(forecast, sizeof(forecast));
+  }
+  return APP_MSG_OK;
+}
+
+// Deliver the simulated configuration the way index.js would
+static void sendConfiguration(void) {
+  if(!messagingOpen) {
+    configPending = true;
+    return;
+  }
+  configPending = false;
+  uint16_t bedtime = (uint16_t)parseClock(options.bedtime);
+  uint16_t getUpTime = (uint16_t)parseClock(options.getUpTime);
+  const uint8_t config[] = {
+    1, 3, (options.batterySaver ? 0x01 : 0x00) | (options.wristPause ? 0x02 : 0x00) |
+    (options.caughtYou ? 0x04 : 0x00), GColorDarkGreen.argb,
+    bedtime & 0xff, bedtime >> 8, getUpTime & 0xff, getUpTime >> 8, (uint8_t)options.borises
+  };
+  sendPacket(config, sizeof(config));
+}
+
+// Event loop
+
+static uint64_t nextMinute(void) {
+  return (wallMs() / 60000ULL + 1) * 60000ULL - clockOffsetMs;
+}
+
+// Set the watch's clock once when it first reads --set-clock's first time,
+// by at most 12 hours either way, as for a daylight saving change
+static void setClock(void) {
+  static bool done;
+  if(done || options.clockFrom < 0 || (int)(wallMs() / 60000ULL % 1440) != options.clockFrom) {
+    return;
+  }
+  done = true;
+  int minutes = (options.clockTo - options.clockFrom + 1440 + 720) % 1440 - 720;
+  clockOffsetMs += minutes * 60000LL;
+}
+
+void app_event_loop(void) {
+  sendConfiguration();
+  render();
+  while(nowMs < endMs) {
+    HostTimer *timer = nextTimer();
+    uint64_t tickDue = tickHandler != NULL ? nextMinute() : UINT64_MAX;
+    uint64_t batchDue = accelHandler != NULL ? accelDue : UINT64_MAX;
+    uint64_t due = timer != NULL && timer->due < tickDue ? timer->due : tickDue;
+    due = batchDue < due ? batchDue : due;
+    // Nobody looks at a watchface that isn't watching for it
+    uint64_t tapDue = tapHandler != NULL ? glanceDue : UINT64_MAX;
+    due = tapDue < due ? tapDue : due;
+    if(due >= endMs) {
+      advanceClock(endMs);
+      break;
+    }
+    advanceClock(due);
+    // Everything due at the same moment is handled in one wakeup
+    COUNT(wakeups, 1);
+    if(due == tickDue) {
+      // The firmware ticks right after the clock is set
+      setClock();
+      time_t t = (time_t)(wallMs() / 1000);
+      tickHandler(host_localtime(&t), MINUTE_UNIT);
+      BatteryChargeState battery = battery_state_service_peek();
+      if(batteryHandler != NULL && battery.charge_percent != batteryReported) {
+        batteryReported = battery.charge_percent;
+        batteryHandler(battery);
+      }
+    }
+    if(due == tapDue) {
+      startGlance();
+    }
+    if(accelHandler != NULL && due == accelDue) {
+      sendAccelBatch();
+    }
+    while((timer = nextTimer()) != NULL && timer->due <= nowMs) {
+      HostTimer fired = *timer;
+      timer->id = 0;
+      fired.callback(fired.data);
+    }
+    if(configPending) {
+      sendConfiguration();
+    }
+    render();
+  }
+}
+
+// Report
+
+static void printStats(const char *label, const Stats *stats) {
+  printf("%-12s %9.0f %9lu %8lu %8lu %12.0f %8lu %8lu %12.0f\n", label, stats->ms / 1000.0,
+         stats->wakeups, stats->flashReads, stats->renders, stats->dirtyPixels, stats->glyphs,
+         stats->messages, energy(stats));
+}
+
+static void printHeader(const char *label) {
+  printf("%-12s %9s %9s %8s %8s %12s %8s %8s %12s\n", label, "seconds", "wakeups", "reads",
+         "renders", "dirty px", "glyphs", "messages", "energy");
+}
+
+static void report(void) {
+  printf("BorisTime host simulation: %d h from %02d:%02d, bedtime %s, get up %s, "
+         "battery saver %s, battery %d%% -> %d%%, seed %u\n\n", options.hours,
+         options.startMinute / 60, options.startMinute % 60, options.bedtime, options.getUpTime,
+         options.batterySaver ? "on" : "off", options.batteryStart, options.batteryEnd, options.seed);
+  if(options.borises != 1) {
+    printf("%d Borises\n\n", options.borises);
+  }
+  if(options.wristPause) {
+    printf("wrist pause on, caught you %s, %d glances per hour\n\n", options.caughtYou ? "on" : "off",
+           options.glances);
+  }
+  if(options.awayFrom >= 0) {
+    printf("closed from %02d:%02d to %02d:%02d\n\n", options.awayFrom / 60, options.awayFrom % 60,
+           options.awayUntil / 60, options.awayUntil % 60);
+  }
+  if(options.clockFrom >= 0) {
+    printf("clock set from %02d:%02d to %02d:%02d\n\n", options.clockFrom / 60, options.clockFrom % 60,
+           options.clockTo / 60, options.clockTo % 60);
+  }
+  printHeader("hour");
+  for(int i = 0; i < options.hours; i++) {
+    char label[16];
+    snprintf(label, sizeof(label), "%02d:00", (options.startMinute / 60 + i) % 24);
+    printStats(label, &hourStats[i]);
+  }
+  printf("\n");
+  printHeader("behaviour");
+  for(uint32_t i = 0; i <= HOST_RESOURCE_COUNT; i++) {
+    if(behavStats[i].ms > 0 || behavStats[i].wakeups > 0) {
+      printStats(i == 0 ? "(startup)" : host_resource_names[i], &behavStats[i]);
+    }
+  }
+  printf("\n");
+  printStats("total", &totalStats);
+  printf("\nwakeups per hour: %.1f\n", totalStats.wakeups / (totalStats.ms / 3600000.0));
+  printf("energy per hour: %.0f\n", energy(&totalStats) / (totalStats.ms / 3600000.0));
+  printf("peak heap: %zu bytes\n", heapPeak);
+  for(int i = 0; i < launchCount; i++) {
+    time_t t = (time_t)(launches[i].at / 1000);
+    struct tm *launched = host_localtime(&t);
+    printf("time to first frame at %02d:%02d: %.1f ms (%lu reads, %lu glyphs)\n", launched->tm_hour,
+           launched->tm_min, launches[i].busyUs / 1000.0, launches[i].flashReads, launches[i].glyphs);
+  }
+}
+
+static int parseClock(const char *text) {
+  int hours, minutes;
+  if(sscanf(text, "%d:%d", &hours, &minutes) != 2) {
+    fprintf(stderr, "Expected HH:MM, got '%s'\n", text);
+    exit(2);
+  }
+  return hours * 60 + minutes;
+}
+
+// Starts the watchface with a cold AppMessage connection, the way opening it
+// from the menu does
+static void launch(void) {
+  Launch *launch = &launches[launchCount++];
+  *launch = (Launch){ .at = nowMs, .flashReads = totalStats.flashReads, .glyphs = totalStats.glyphs };
+  busyUs = 0;
+  awaitingFirstFrame = true;
+  messagingOpen = false;
+  pebble_main();
+}
+
+static void usage(const char *name) {
+  fprintf(stderr,
+          "Usage: %s [options]\n"
+          "  --hours N          simulated duration (default 24)\n"
+          "  --start HH:MM      time of day the watchface starts (default 12:00)\n"
+          "  --bedtime HH:MM    Bedtime setting (default 22:00)\n"
+          "  --getup HH:MM      GetUpTime setting (default 08:00)\n"
+          "  --battery-saver    turn the BatterySaver setting on\n"
+          "  --wrist-pause      turn the WristPause setting on\n"
+          "  --caught-you       turn the CaughtYou setting on\n"
+          "  --glances N        times an hour the wearer looks at the watch (default 12)\n"
+          "  --borises N        BorisCount setting, 1 to 4 (default 1)\n"
+          "  --battery A[:B]    battery level at the start, and optionally the end\n"
+          "  --seed N           random seed (default 1)\n"
+          "  --away HH:MM-HH:MM close the watchface at the first time and reopen it at the second\n"
+          "  --set-clock HH:MM-HH:MM  set the watch's clock to the second time at the first\n"
+          "  --verbose          show all APP_LOG output\n", name);
+  exit(2);
+}
+
+int main(int argc, char **argv) {
+  for(int i = 1; i < argc; i++) {
+    const char *arg = argv[i];
+    const char *value = i + 1 < argc ? argv[i + 1] : NULL;
+    if(!strcmp(arg, "--hours") && value) {
+      options.hours = atoi(value);
+      i++;
+    } else if(!strcmp(arg, "--start") && value) {
+      options.startMinute = parseClock(value);
+      i++;
+    } else if(!strcmp(arg, "--bedtime") && value) {
+      parseClock(value);
+      options.bedtime = value;
+      i++;
+    } else if(!strcmp(arg, "--getup") && value) {
+      parseClock(value);
+      options.getUpTime = value;
+      i++;
+    } else if(!strcmp(arg, "--battery-saver")) {
+      options.batterySaver = true;
+    } else if(!strcmp(arg, "--wrist-pause")) {
+      options.wristPause = true;
+    } else if(!strcmp(arg, "--caught-you")) {
+      options.caughtYou = true;
+    } else if(!strcmp(arg, "--glances") && value) {
+      options.glances = atoi(value);
+      i++;
+    } else if(!strcmp(arg, "--borises") && value) {
+      options.borises = atoi(value);
+      i++;
+    } else if(!strcmp(arg, "--battery") && value) {
+      if(sscanf(value, "%d:%d", &options.batteryStart, &options.batteryEnd) == 1) {
+        options.batteryEnd = options.batteryStart;
+      }
+      i++;
+    } else if(!strcmp(arg, "--seed") && value) {
+      options.seed = (unsigned)atoi(value);
+      i++;
+    } else if(!strcmp(arg, "--away") && value) {
+      const char *until = strchr(value, '-');
+      if(until == NULL) {
+        usage(argv[0]);
+      }
+      options.awayFrom = parseClock(value);
+      options.awayUntil = parseClock(until + 1);
+      i++;
+    } else if(!strcmp(arg, "--set-clock") && value) {
+      const char *to = strchr(value, '-');
+      if(to == NULL) {
+        usage(argv[0]);
+      }
+      options.clockFrom = parseClock(value);
+      options.clockTo = parseClock(to + 1);
+      i++;
+    } else if(!strcmp(arg, "--verbose")) {
+      options.verbose = true;
+    } else {
+      usage(argv[0]);
+    }
+  }
+  if(options.hours <= 0) {
+    usage(argv[0]);
+  }
+  hourStats = calloc(options.hours, sizeof(Stats));
+  nowMs = EPOCH_MS + options.startMinute * 60000ULL;
+  endMs = nowMs + options.hours * 3600000ULL;
+  batteryReported = battery_state_service_peek().charge_percent;
+  srand(options.seed);
+  hostSeed = options.seed;
+  framebuffer = createBitmap(GSize(SCREEN_WIDTH, SCREEN_HEIGHT), GBitmapFormat8Bit);
+  heapUsed = heapPeak = 0;
+
+  if(options.awayFrom >= 0 &&
+     (options.awayUntil - options.startMinute + 1440) % 1440 <=
+     (options.awayFrom - options.startMinute + 1440) % 1440) {
+    fprintf(stderr, "--away must end after it starts\n");
+    exit(2);
+  }
+  if(options.awayFrom >= 0) {
+    // Run until the watchface is closed, then skip the time it was away
+    uint64_t startMs = nowMs;
+    uint64_t runEndMs = endMs;
+    endMs = startMs + ((options.awayFrom - options.startMinute + 1440) % 1440) * 60000ULL;
+    launch();
+    nowMs = startMs + ((options.awayUntil - options.startMinute + 1440) % 1440) * 60000ULL;
+    endMs = runEndMs;
+  }
+  launch();
+
+  report();
+  return 0;
+}
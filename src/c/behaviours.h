@@ -0,0 +1,72 @@
+// Generated by tools/behavc.py from resources/behaviours.json, do not edit.
+//
+// For each behaviour: the resource, frame count, length of one play in ms
+// and the energy it takes in the host simulator's units, fun weight for the
+// random pick, BEHAV_* flags, the behaviour that always follows it or
+// BEHAV_NO_NEXT, and how fast Boris moves in it. BEHAV_MIRRORED ones are
+// drawn flipped from another behaviour's resource
+#pragma once
+
+#define WALKLEFT 0
+#define WALKRIGHT 1
+#define WALKUP 2
+#define WALKDOWN 3
+#define STANDING 4
+#define SLEEPING 5
+#define SHREDDING 6
+#define EATING 7
+#define INVADERS 8
+#define COFFEE 9
+#define SHOWER 10
+#define READPAPER 11
+#define SCARE 12
+#define SUNGLASSES 13
+#define TONGUEOUT 14
+#define WEEWEE 15
+#define BALLOON 16
+#define GIFTWRAP 17
+#define GOTOSLEEP 18
+#define GETUP 19
+#define BEHAV_COUNT 20
+
+#define BEHAV_ONE_SHOT 0x01
+#define BEHAV_PINNED 0x02
+#define BEHAV_NEXT_ASLEEP 0x04
+#define BEHAV_MIRRORED 0x08
+#define BEHAV_NO_NEXT 0xFF
+
+typedef struct BehavInfo {
+  uint32_t resource;
+  uint8_t frames;
+  uint8_t weight;
+  uint8_t flags;
+  uint8_t next;
+  uint16_t ms;
+  uint16_t cost;
+  // Fixed point pixels per second
+  int16_t vx;
+  int16_t vy;
+} BehavInfo;
+
+static const BehavInfo behavInfos[BEHAV_COUNT] = {
+  [WALKLEFT] = { RESOURCE_ID_WALKLEFT, 5, 13, BEHAV_PINNED, BEHAV_NO_NEXT, 1000, 629, -2560, 0 },
+  [WALKRIGHT] = { RESOURCE_ID_WALKLEFT, 5, 13, BEHAV_PINNED | BEHAV_MIRRORED, BEHAV_NO_NEXT, 1000, 629, 2560, 0 },
+  [WALKUP] = { RESOURCE_ID_WALKUP, 5, 13, BEHAV_PINNED, BEHAV_NO_NEXT, 1000, 617, 0, -1280 },
+  [WALKDOWN] = { RESOURCE_ID_WALKDOWN, 5, 13, BEHAV_PINNED, BEHAV_NO_NEXT, 1000, 615, 0, 1280 },
+  [STANDING] = { RESOURCE_ID_STANDING, 2, 4, BEHAV_PINNED, BEHAV_NO_NEXT, 1550, 237, 0, 0 },
+  [SLEEPING] = { RESOURCE_ID_SLEEPING, 6, 4, 0, BEHAV_NO_NEXT, 4832, 690, 0, 0 },
+  [SHREDDING] = { RESOURCE_ID_SHREDDING, 5, 4, 0, BEHAV_NO_NEXT, 750, 631, 0, 0 },
+  [EATING] = { RESOURCE_ID_EATING, 15, 4, 0, BEHAV_NO_NEXT, 2250, 1712, 0, 0 },
+  [INVADERS] = { RESOURCE_ID_INVADERS, 37, 4, BEHAV_ONE_SHOT, BEHAV_NO_NEXT, 10100, 4414, 0, 0 },
+  [COFFEE] = { RESOURCE_ID_COFFEE, 12, 4, 0, BEHAV_NO_NEXT, 3600, 1471, 0, 0 },
+  [SHOWER] = { RESOURCE_ID_SHOWER, 53, 4, BEHAV_ONE_SHOT, BEHAV_NO_NEXT, 12462, 6242, 0, 0 },
+  [READPAPER] = { RESOURCE_ID_READPAPER, 41, 4, BEHAV_ONE_SHOT, BEHAV_NO_NEXT, 15400, 4730, 0, 0 },
+  [SCARE] = { RESOURCE_ID_SCARE, 21, 4, BEHAV_ONE_SHOT, BEHAV_NO_NEXT, 4900, 2476, 0, 0 },
+  [SUNGLASSES] = { RESOURCE_ID_SUNGLASSES, 22, 4, BEHAV_ONE_SHOT, BEHAV_NO_NEXT, 8100, 2553, 0, 0 },
+  [TONGUEOUT] = { RESOURCE_ID_TONGUEOUT, 23, 4, BEHAV_ONE_SHOT, BEHAV_NO_NEXT, 2700, 2644, 0, 0 },
+  [WEEWEE] = { RESOURCE_ID_WEEWEE, 30, 4, BEHAV_ONE_SHOT, SHOWER, 5900, 3447, 0, 0 },
+  [BALLOON] = { RESOURCE_ID_BALLOON, 37, 4, BEHAV_ONE_SHOT, BEHAV_NO_NEXT, 8132, 4459, 0, 0 },
+  [GIFTWRAP] = { RESOURCE_ID_GIFTWRAP, 52, 4, BEHAV_ONE_SHOT, BEHAV_NO_NEXT, 12000, 6285, 0, 0 },
+  [GOTOSLEEP] = { RESOURCE_ID_GOTOSLEEP, 21, 0, BEHAV_ONE_SHOT | BEHAV_NEXT_ASLEEP, SLEEPING, 5100, 2528, 0, 0 },
+  [GETUP] = { RESOURCE_ID_GETUP, 8, 0, BEHAV_ONE_SHOT, SHOWER, 1600, 975, 0, 0 }
+};
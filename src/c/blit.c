@@ -0,0 +1,147 @@
+#include "blit.h"
+
+// Transparent pixels are skipped a 32-bit word of source data at a time
+#define BLIT_WORD 4
+#define BLIT_ALPHA_MASK 0xC0C0C0C0
+
+static uint8_t formatBits(GBitmapFormat format) {
+  switch(format) {
+    case GBitmapFormat1BitPalette:
+      return 1;
+    case GBitmapFormat2BitPalette:
+      return 2;
+    case GBitmapFormat4BitPalette:
+      return 4;
+    default:
+      return 8;
+  }
+}
+
+static void blitRow8(uint8_t *dst, const uint8_t *src, int count) {
+  int x = 0;
+  while(x < count) {
+    if(count - x >= BLIT_WORD) {
+      uint32_t word;
+      memcpy(&word, src + x, BLIT_WORD);
+      uint32_t alpha = word & BLIT_ALPHA_MASK;
+      if(alpha == 0) {
+        x += BLIT_WORD;
+        continue;
+      }
+      if(alpha == BLIT_ALPHA_MASK) {
+        memcpy(dst + x, &word, BLIT_WORD);
+        x += BLIT_WORD;
+        continue;
+      }
+    }
+    if(src[x] & 0xC0) {
+      dst[x] = src[x];
+    }
+    x++;
+  }
+}
+
+// first is the column of the first pixel in the source row
+static void blitRowPalette(uint8_t *dst, const uint8_t *src, int first, int count, uint8_t bits,
+                           const uint8_t *colors, bool zeroClear) {
+  const uint8_t perByte = 8 / bits;
+  const uint8_t mask = (1 << bits) - 1;
+  const int perWord = perByte * BLIT_WORD;
+  int x = 0;
+  while(x < count) {
+    int sx = first + x;
+    if(zeroClear && sx % perWord == 0 && count - x >= perWord) {
+      uint32_t word;
+      memcpy(&word, src + sx / perByte, BLIT_WORD);
+      if(word == 0) {
+        x += perWord;
+        continue;
+      }
+    }
+    uint8_t index = (src[sx / perByte] >> (8 - bits * (sx % perByte + 1))) & mask;
+    if(colors[index] & 0xC0) {
+      dst[x] = colors[index];
+    }
+    x++;
+  }
+}
+
+static uint8_t pixelIndex(const uint8_t *row, int x, uint8_t bits) {
+  const uint8_t perByte = 8 / bits;
+  return (row[x / perByte] >> (8 - bits * (x % perByte + 1))) & ((1 << bits) - 1);
+}
+
+// Mirrored rows are read right to left from last, the source column of the
+// first pixel drawn. The source is never word aligned that way, so there are
+// no word at a time skips
+static void blitRowMirrored(uint8_t *dst, const uint8_t *src, int last, int count, uint8_t bits,
+                            const uint8_t *colors) {
+  for(int x = 0; x < count; x++) {
+    uint8_t color = bits == 8 ? src[last - x] : colors[pixelIndex(src, last - x, bits)];
+    if(color & 0xC0) {
+      dst[x] = color;
+    }
+  }
+}
+
+void blitSet(GBitmap *framebuffer, const GBitmap *bitmap, GPoint origin, bool mirror) {
+  GSize size = gbitmap_get_bounds(bitmap).size;
+  GSize screen = gbitmap_get_bounds(framebuffer).size;
+  const uint8_t *data = gbitmap_get_data(bitmap);
+  uint16_t stride = gbitmap_get_bytes_per_row(bitmap);
+  uint8_t bits = formatBits(gbitmap_get_format(bitmap));
+
+  // Palette as raw colours, so a pixel is a single lookup
+  uint8_t colors[16];
+  bool zeroClear = false;
+  if(bits < 8) {
+    const GColor *palette = gbitmap_get_palette(bitmap);
+    for(int i = 0; i < (1 << bits); i++) {
+      colors[i] = palette[i].argb;
+    }
+    zeroClear = (colors[0] & 0xC0) == 0;
+  }
+
+  int top = origin.y < 0 ? -origin.y : 0;
+  int bottom = origin.y + size.h > screen.h ? screen.h - origin.y : size.h;
+  for(int y = top; y < bottom; y++) {
+    GBitmapDataRowInfo row = gbitmap_get_data_row_info(framebuffer, origin.y + y);
+    int left = row.min_x > origin.x ? row.min_x : origin.x;
+    int right = row.max_x < origin.x + size.w - 1 ? row.max_x : origin.x + size.w - 1;
+    if(left > right) {
+      continue;
+    }
+    const uint8_t *src = data + y * stride;
+    if(mirror) {
+      blitRowMirrored(row.data + left, src, size.w - 1 - (left - origin.x), right - left + 1, bits, colors);
+    } else if(bits == 8) {
+      blitRow8(row.data + left, src + left - origin.x, right - left + 1);
+    } else {
+      blitRowPalette(row.data + left, src, left - origin.x, right - left + 1, bits, colors, zeroClear);
+    }
+  }
+}
+
+void blitMirror(GBitmap *mirror, const GBitmap *bitmap) {
+  GSize size = gbitmap_get_bounds(bitmap).size;
+  const uint8_t *data = gbitmap_get_data(bitmap);
+  uint8_t *out = gbitmap_get_data(mirror);
+  uint16_t stride = gbitmap_get_bytes_per_row(bitmap);
+  uint16_t outStride = gbitmap_get_bytes_per_row(mirror);
+  uint8_t bits = formatBits(gbitmap_get_format(bitmap));
+  const uint8_t perByte = 8 / bits;
+  for(int y = 0; y < size.h; y++) {
+    const uint8_t *src = data + y * stride;
+    uint8_t *dst = out + y * outStride;
+    if(bits == 8) {
+      for(int x = 0; x < size.w; x++) {
+        dst[x] = src[size.w - 1 - x];
+      }
+      continue;
+    }
+    memset(dst, 0, (size.w + perByte - 1) / perByte);
+    for(int x = 0; x < size.w; x++) {
+      dst[x / perByte] |= pixelIndex(src, size.w - 1 - x, bits) << (8 - bits * (x % perByte + 1));
+    }
+  }
+}
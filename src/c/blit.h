@@ -0,0 +1,14 @@
+#pragma once
+
+#include <pebble.h>
+
+// Draw bitmap into an 8-bit framebuffer with its top left corner at origin,
+// leaving the pixels under transparent ones alone like GCompOpSet does.
+// Takes 8-bit and 1, 2 and 4-bit palettized bitmaps. Clipped to the
+// framebuffer, including the visible part of each row on round screens.
+// mirror flips the bitmap left to right as it is drawn
+void blitSet(GBitmap *framebuffer, const GBitmap *bitmap, GPoint origin, bool mirror);
+
+// Copy bitmap into mirror flipped left to right, for framebuffers blitSet
+// can't draw into. Both must have the same format and size
+void blitMirror(GBitmap *mirror, const GBitmap *bitmap);
@@ -0,0 +1,43 @@
+#pragma once
+
+// Sizes of everything the watchface keeps for as long as the window is open.
+// Nothing here grows past these, so together they are the app's memory
+// ceiling. tools/membudget.py reads this file and the statics of the linked
+// app, reports each subsystem's share at build time, and fails the build
+// when they add up to more than MEMORY_BUDGET. Keep every define on one
+// line so it can parse them
+
+// Open behaviour decoders, see getBehav() in main.c. Must be larger than the
+// number of pinned resources plus the players that can hold the others
+#define BEHAV_CACHE_SLOTS 8
+
+// Sprites come from a static pool with a slot for every cached decoder.
+// Their palettes are held in the slot, so sprites with more colours than
+// this are refused by tools/spritec.py
+#define SPRITE_SLOTS BEHAV_CACHE_SLOTS
+#define SPRITE_MAX_COLORS 32
+// Frame data is streamed through one buffer all sprites share
+#define SPRITE_BUFFER_SIZE 128
+
+// Borises on screen at most, and players (decoder, canvas and frame deadline)
+// they share, see main.c
+#define BORIS_MAX 4
+#define PLAYER_SLOTS 3
+
+// Pre-decoded frames of short loops, see getFrameRing() in main.c. Set
+// FRAME_RING_MAX_FRAMES to 0 to stream everything
+#define FRAME_RINGS 2
+#define FRAME_RING_MAX_FRAMES 6
+#define FRAME_RING_COLORS 16
+
+// 8-bit pixels held by the cached clock, date and temperature bitmaps
+// together. Text that doesn't fit is drawn directly instead
+#define TEXT_CACHE_BYTES (12 * 1024)
+
+// Hours of weather forecast the phone sends at once, see PACKET_FORECAST in
+// main.c
+#define FORECAST_SLOTS 24
+
+// What the subsystems above and every other static may add up to. The SDK's
+// own objects (layers, fonts, the AppMessage buffers) come on top
+#define MEMORY_BUDGET (32 * 1024)
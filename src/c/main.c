@@ -1,366 +1,2023 @@
 #include <pebble.h>
+#include "blit.h"
+#include "budget.h"
+#include "perf.h"
+#include "sprite.h"
+#include "behaviours.h"
 
 static Window *mainWindow;
-static TextLayer *timeLayer;
-static TextLayer *timeShadowLayer;
-static TextLayer *dateLayer;
-static TextLayer *dateShadowLayer;
+static Layer *textLayer;
 static GFont timeFont;
-static BitmapLayer *borisLayer;
+static Layer *borisLayer;
 static BitmapLayer *weatherIconLayer;
-static TextLayer *weatherTextLayer;
-static TextLayer *weatherTextShadowLayer;
 static GFont weatherFont;
 static int batteryLevel;
 static Layer *batteryLayer;
-static AppTimer *frameTimer;
-static AppTimer *behavTimer;
-static GBitmap *borisBitmap;
+static GSize screenSize;
 static GBitmap *weatherBitmap;
-static GBitmapSequence *curBehav;
-
-static GBitmap *wIcon01d;
-static GBitmap *wIcon01n;
-static GBitmap *wIcon02d;
-static GBitmap *wIcon02n;
-static GBitmap *wIcon03d;
-static GBitmap *wIcon03n;
-static GBitmap *wIcon04d;
-static GBitmap *wIcon04n;
-static GBitmap *wIcon09d;
-static GBitmap *wIcon09n;
-static GBitmap *wIcon10d;
-static GBitmap *wIcon10n;
-static GBitmap *wIcon11d;
-static GBitmap *wIcon11n;
-static GBitmap *wIcon13d;
-static GBitmap *wIcon13n;
-static GBitmap *wIcon50d;
-static GBitmap *wIcon50n;
-
-static bool oneShot;
-static GBitmapSequence *bhStanding;
-static GBitmapSequence *bhSleeping;
-static GBitmapSequence *bhWalkLeft;
-static GBitmapSequence *bhWalkRight;
-static GBitmapSequence *bhWalkDown;
-static GBitmapSequence *bhWalkUp;
-static GBitmapSequence *bhShredding;
-static GBitmapSequence *bhEating;
-static GBitmapSequence *bhInvaders;
-static GBitmapSequence *bhCoffee;
-static GBitmapSequence *bhShower;
-static GBitmapSequence *bhReadPaper;
-static GBitmapSequence *bhGoToSleep;
-static GBitmapSequence *bhGetUp;
-static GBitmapSequence *bhScare;
-static GBitmapSequence *bhSunglasses;
-static GBitmapSequence *bhTongueOut;
-static GBitmapSequence *bhWeeWee;
-static GBitmapSequence *bhBalloon;
-static GBitmapSequence *bhGiftWrap;
+
+static GBitmap *weatherIcons;
 
 #define RANDOM 666
 #define INFINITE 667
+// Stand still until the energy budget allows another behaviour
+#define REST 668
+
+// Looping behaviours play for a random time in this range
+#define LOOP_MS_MIN 4000
+#define LOOP_MS_MAX 8000
+
+// Positions are fixed point, in 1/FIXED_ONE of a pixel
+#define FIXED_SHIFT 8
+#define FIXED_ONE (1 << FIXED_SHIFT)
+
+// The behaviour ids and behavInfos come from resources/behaviours.json, see
+// tools/behavc.py
+static const BehavInfo *behavInfo(uint32_t behav) {
+  return &behavInfos[behav];
+}
+
+static bool behavOneShot(uint32_t behav) {
+  return (behavInfo(behav)->flags & BEHAV_ONE_SHOT) != 0;
+}
+
+// Energy per second while a looping behaviour plays
+static uint32_t behavRate(uint32_t behav) {
+  const BehavInfo *info = behavInfo(behav);
+  return (uint32_t)info->cost * 1000 / info->ms;
+}
+
+// Behaviour decoders are opened when needed and kept in a small LRU cache of
+// BEHAV_CACHE_SLOTS, see budget.h. They are cached by resource, so a
+// behaviour that mirrors another reuses its decoder. A decoder plays for one
+// player at a time, so both directions at once take two
+
+typedef struct BehavSlot {
+  uint32_t resource;
+  // Never evicted, see behavPinned()
+  bool pinned;
+  Sprite *sprite;
+  uint32_t lastUsed;
+} BehavSlot;
+
+static BehavSlot behavCache[BEHAV_CACHE_SLOTS];
+static uint32_t behavCacheClock;
+
+static bool spriteInUse(const Sprite *sprite);
+
+// The behaviours picked most often are never evicted
+static bool behavPinned(uint32_t behav) {
+  return (behavInfo(behav)->flags & BEHAV_PINNED) != 0;
+}
+
+// Returns an open decoder for the behaviour that no player is using, or NULL
+// if it couldn't be created
+static Sprite *getBehav(uint32_t behav) {
+  uint32_t resource = behavInfo(behav)->resource;
+  BehavSlot *victim = NULL;
+  bool held = false;
+  behavCacheClock++;
+  for(int i = 0; i < BEHAV_CACHE_SLOTS; i++) {
+    BehavSlot *slot = &behavCache[i];
+    if(slot->sprite == NULL || slot->resource != resource) {
+      continue;
+    }
+    held = true;
+    if(!spriteInUse(slot->sprite)) {
+      slot->lastUsed = behavCacheClock;
+      slot->pinned = slot->pinned || behavPinned(behav);
+      return slot->sprite;
+    }
+  }
+  // Not cached. Use a free slot if there is one, otherwise evict the least
+  // recently used decoder that isn't pinned or playing
+  for(int i = 0; i < BEHAV_CACHE_SLOTS; i++) {
+    BehavSlot *slot = &behavCache[i];
+    if(slot->sprite == NULL) {
+      victim = slot;
+      break;
+    }
+    if(!slot->pinned && !spriteInUse(slot->sprite) &&
+       (victim == NULL || slot->lastUsed < victim->lastUsed)) {
+      victim = slot;
+    }
+  }
+  if(victim == NULL) {
+    return NULL;
+  }
+  if(victim->sprite != NULL) {
+    spriteDestroy(victim->sprite);
+  }
+  victim->resource = resource;
+  // One pinned decoder per resource is enough, a second one is only for
+  // while both are playing
+  victim->pinned = behavPinned(behav) && !held;
+  victim->lastUsed = behavCacheClock;
+  victim->sprite = spriteCreate(resource);
+  return victim->sprite;
+}
+
+static void unloadBehavs() {
+  for(int i = 0; i < BEHAV_CACHE_SLOTS; i++) {
+    if(behavCache[i].sprite != NULL) {
+      spriteDestroy(behavCache[i].sprite);
+      behavCache[i].sprite = NULL;
+    }
+  }
+}
+
+// Persistent storage keys. Settings were stored under key 1 before the
+// times of day were kept by value
+#define OLD_SETTINGS_KEY 1
+#define SETTINGS_KEY 2
+#define SCENE_KEY 3
+#define FORECAST_KEY 4
+
+// Minute of day for a time that isn't set
+#define NO_TIME 0xFFFF
+#define MINUTES_PER_DAY (24 * 60)
+
+// The phone and the watch exchange a single byte array under
+// MESSAGE_KEY_PACKET. It starts with the protocol version and the packet
+// type, the rest depends on the type. index.js has the same layout
+#define PACKET_VERSION 1
+#define PACKET_MAX_SIZE (6 + 2 * FORECAST_SLOTS)
+
+// Watch to phone, no payload
+#define PACKET_WEATHER_REQUEST 1
+// int8 temperature in Celsius, uint8 icon. The icon is the OpenWeatherMap
+// condition number, with PACKET_ICON_NIGHT set for night icons
+#define PACKET_WEATHER 2
+// uint8 flags, uint8 background GColor8, then bedtime and get-up time as
+// little endian uint16 minutes of day, NO_TIME when not set, then uint8
+// number of Borises. Older phones leave out the number
+#define PACKET_CONFIG 3
+// Watch to phone, performance counters as written by perfWriteSummary()
+#define PACKET_PERF 4
+// uint32 little endian UTC time of the first hour, then int8 temperature and
+// uint8 icon for every hour from then on, as in PACKET_WEATHER. At most
+// FORECAST_SLOTS hours. The phone sends this instead of PACKET_WEATHER now,
+// which older phones still send
+#define PACKET_FORECAST 5
+
+#define PACKET_ICON_NIGHT 0x80
+#define CONFIG_BATTERY_SAVER 0x01
+#define CONFIG_WRIST_PAUSE 0x02
+#define CONFIG_CAUGHT_YOU 0x04
+
+// Define our settings struct
+typedef struct AppSettings {
+  GColor bgColor;
+  uint32_t state;
+  int borisX;
+  int borisY;
+  int borisSize;
+  uint16_t bedtime;
+  uint16_t getUpTime;
+  bool batterySaver;
+  time_t lastSeen;
+  bool wristPause;
+  bool caughtYou;
+  uint8_t borisCount;
+} AppSettings;
+
+static AppSettings settings;
+
+// The layout stored under OLD_SETTINGS_KEY, with the watch's 32-bit
+// pointers to the times of day
+typedef struct OldAppSettings {
+  GColor bgColor;
+  uint32_t state;
+  int borisX;
+  int borisY;
+  int borisSize;
+  uint32_t borisBedtime;
+  uint32_t borisGetUpTime;
+  bool batterySaver;
+} OldAppSettings;
+
+static void defaultSettings() {
+  settings.bgColor = PBL_IF_COLOR_ELSE(GColorDarkGreen, GColorBlack);
+  settings.state = STANDING;
+  settings.borisX = 60;
+  settings.borisY = 90;
+  settings.borisSize = 32;
+  settings.bedtime = 22 * 60;
+  settings.getUpTime = 8 * 60;
+  settings.batterySaver = false;
+  settings.lastSeen = 0;
+  settings.wristPause = false;
+  settings.caughtYou = false;
+  settings.borisCount = 1;
+}
+
+// Read settings from persistent storage
+static void loadSettings() {
+  // Load the default settings
+  defaultSettings();
+  // Read settings from persistent storage, if they exist
+  persist_read_data(SETTINGS_KEY, &settings, sizeof(settings));
+  // The old layout stored pointers to the times, which are lost, but the
+  // background and battery saver carry over
+  if(persist_exists(OLD_SETTINGS_KEY)) {
+    OldAppSettings old;
+    if(!persist_exists(SETTINGS_KEY) &&
+       persist_read_data(OLD_SETTINGS_KEY, &old, sizeof(old)) == (int)sizeof(old)) {
+      settings.bgColor = old.bgColor;
+      settings.batterySaver = old.batterySaver;
+    }
+    persist_delete(OLD_SETTINGS_KEY);
+  }
+  // The specials used to have ids 42 and 43
+  if(settings.state >= BEHAV_COUNT) {
+    settings.state = STANDING;
+  }
+}
+
+// Save the settings to persistent storage
+static void saveSettings() {
+  persist_write_data(SETTINGS_KEY, &settings, sizeof(settings));
+}
+
+// Black and white screens keep a black background whatever was configured,
+// the text is white
+static GColor backgroundColor() {
+  return PBL_IF_COLOR_ELSE(settings.bgColor, GColorBlack);
+}
+
+// Short looping behaviours are decoded once into copies of the palettized
+// canvas and then replayed from memory. Loops with more frames than
+// FRAME_RING_MAX_FRAMES (and all one-shot behaviours) are streamed from the
+// sprite as usual. The ring sizes are in budget.h. Rings hold a resource's
+// frames as decoded, so a behaviour that mirrors another shares its ring
+
+typedef struct FrameRing {
+  uint32_t resource;
+  uint32_t lastUsed;
+  uint8_t count;
+  uint8_t filled;
+  bool failed;
+  GColor palette[FRAME_RING_COLORS];
+  uint16_t delays[FRAME_RING_MAX_FRAMES];
+} FrameRing;
+
+static FrameRing frameRings[FRAME_RINGS];
+// Frame bitmaps are pooled and reused by whichever behaviour owns the ring
+static GBitmap *framePool[FRAME_RINGS][FRAME_RING_MAX_FRAMES];
+static uint32_t frameRingClock;
+
+static bool ringInUse(const FrameRing *ring);
+
+// Returns the ring for a looping behaviour's resource, or NULL if it should be
+// streamed. Rings other players are using are never taken over
+static FrameRing *getFrameRing(uint32_t resource, uint32_t frames) {
+  if(frames > FRAME_RING_MAX_FRAMES) {
+    return NULL;
+  }
+  FrameRing *victim = NULL;
+  frameRingClock++;
+  for(int i = 0; i < FRAME_RINGS; i++) {
+    FrameRing *ring = &frameRings[i];
+    if(ring->count > 0 && ring->resource == resource) {
+      ring->lastUsed = frameRingClock;
+      return ring->failed ? NULL : ring;
+    }
+    if(!ringInUse(ring) && (victim == NULL || ring->lastUsed < victim->lastUsed)) {
+      victim = ring;
+    }
+  }
+  if(victim == NULL) {
+    return NULL;
+  }
+  victim->resource = resource;
+  victim->lastUsed = frameRingClock;
+  victim->count = frames;
+  victim->filled = 0;
+  victim->failed = false;
+  return victim;
+}
+
+static uint8_t paletteColors(GBitmapFormat format) {
+  switch(format) {
+    case GBitmapFormat1BitPalette:
+      return 2;
+    case GBitmapFormat2BitPalette:
+      return 4;
+    case GBitmapFormat4BitPalette:
+      return 16;
+    default:
+      return 0;
+  }
+}
+
+// Copy the frame just decoded into canvas into the ring. The ring keeps its
+// own copy of the palette, as the sprite may be evicted while the ring is
+// still in use. Gives up on behaviours with an 8-bit canvas
+static void storeRingFrame(FrameRing *ring, const GBitmap *canvas, uint8_t idx, uint32_t delay) {
+  GBitmapFormat format = gbitmap_get_format(canvas);
+  uint8_t colors = paletteColors(format);
+  if(colors == 0 || colors > FRAME_RING_COLORS) {
+    ring->failed = true;
+    return;
+  }
+  if(idx == 0) {
+    memcpy(ring->palette, gbitmap_get_palette(canvas), colors * sizeof(GColor));
+  }
+  GSize size = gbitmap_get_bounds(canvas).size;
+  GBitmap **frame = &framePool[ring - frameRings][idx];
+  GRect frameBounds = *frame != NULL ? gbitmap_get_bounds(*frame) : GRectZero;
+  if(*frame != NULL && (gbitmap_get_format(*frame) != format || !gsize_equal(&size, &frameBounds.size))) {
+    gbitmap_destroy(*frame);
+    *frame = NULL;
+  }
+  if(*frame == NULL) {
+    *frame = gbitmap_create_blank_with_palette(size, format, ring->palette, false);
+    if(*frame == NULL) {
+      ring->failed = true;
+      return;
+    }
+  }
+  memcpy(gbitmap_get_data(*frame), gbitmap_get_data(canvas), size.h * gbitmap_get_bytes_per_row(canvas));
+  ring->delays[idx] = delay;
+  ring->filled = idx + 1;
+}
+
+static void unloadFrameRings() {
+  for(int i = 0; i < FRAME_RINGS; i++) {
+    for(int j = 0; j < FRAME_RING_MAX_FRAMES; j++) {
+      if(framePool[i][j] != NULL) {
+        gbitmap_destroy(framePool[i][j]);
+        framePool[i][j] = NULL;
+      }
+    }
+    frameRings[i].count = 0;
+  }
+}
+
+// Up to BORIS_MAX Borises can be out at once, settings.borisCount of them
+// are. A Boris only keeps his position, behaviour and behaviour deadline.
+// Borises in the same behaviour share a player, which owns the decoder, the
+// canvas and the frame deadline, so they move in step and every frame is
+// decoded once however many of them show it
+#define NO_PLAYER 0xFF
+
+typedef struct Player {
+  uint8_t behav;
+  uint8_t users;
+  // Advanced by the minute tick instead of a timer
+  bool asleep;
+  // The one-shot ends at frameDue instead of showing another frame
+  bool ends;
+  // Frames are drawn flipped, see BEHAV_MIRRORED
+  bool mirrored;
+  // To be fast forwarded to seekFrame, see seekPlayers()
+  bool seeking;
+  uint8_t seekFrame;
+  uint8_t ringFrame;
+  Sprite *sprite;
+  // Canvas for streamed frames, see spriteCanvas(). A free player keeps it
+  // for the next behaviour
+  GBitmap *canvas;
+#if defined(PBL_BW)
+  // Mirrored frames flipped for graphics_draw_bitmap_in_rect, see
+  // mirrorFrame(). Kept for the next behaviour like the canvas
+  GBitmap *flipped;
+#endif
+  FrameRing *ring;
+  // Frame on screen, NULL until the first one is decoded
+  const GBitmap *frame;
+  uint64_t frameDue;
+  // The loop is paid for until then, see loopCost()
+  uint64_t paidUntil;
+} Player;
+
+typedef struct Boris {
+  // Fixed point, see pixels()
+  int32_t x;
+  int32_t y;
+  uint8_t behav;
+  // Index into players, NO_PLAYER when he has nothing to show
+  uint8_t player;
+  // Shows his player's current frame without moving until behavDue
+  bool resting;
+  uint64_t behavDue;
+  // schedNow() when his position was last brought up to date
+  uint64_t movedAt;
+} Boris;
+
+static Player players[PLAYER_SLOTS];
+static Boris borises[BORIS_MAX];
+static uint8_t borisCount;
+
+static void nextFrame(Player *player);
+static void changeBehaviour(Boris *boris, uint32_t newBehav, uint32_t duration);
+
+static int16_t pixels(int32_t fixed) {
+  return fixed >> FIXED_SHIFT;
+}
+
+static int32_t toFixed(int16_t pixels) {
+  return (int32_t)pixels * FIXED_ONE;
+}
+
+static Player *borisPlayer(const Boris *boris) {
+  return boris->player != NO_PLAYER ? &players[boris->player] : NULL;
+}
+
+static bool spriteInUse(const Sprite *sprite) {
+  for(int i = 0; i < PLAYER_SLOTS; i++) {
+    if(players[i].users > 0 && players[i].sprite == sprite) {
+      return true;
+    }
+  }
+  return false;
+}
+
+static bool ringInUse(const FrameRing *ring) {
+  for(int i = 0; i < PLAYER_SLOTS; i++) {
+    if(players[i].users > 0 && players[i].ring == ring) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// The player showing the behaviour, if anyone is in it
+static Player *findPlayer(uint32_t behav) {
+  for(int i = 0; i < PLAYER_SLOTS; i++) {
+    if(players[i].users > 0 && players[i].behav == behav) {
+      return &players[i];
+    }
+  }
+  return NULL;
+}
+
+// Does anyone in the player move, or are they all resting?
+static bool playerActive(const Player *player) {
+  for(int i = 0; i < borisCount; i++) {
+    if(borisPlayer(&borises[i]) == player && !borises[i].resting) {
+      return true;
+    }
+  }
+  return false;
+}
+
+static bool borisAsleep(const Boris *boris) {
+  Player *player = borisPlayer(boris);
+  return player != NULL && player->asleep;
+}
+
+static bool allAsleep() {
+  for(int i = 0; i < borisCount; i++) {
+    if(!borisAsleep(&borises[i])) {
+      return false;
+    }
+  }
+  return borisCount > 0;
+}
+
+// Can a random pick send a Boris into the behaviour? He can join any loop,
+// but a one-shot only in its first frame so he doesn't start halfway through
+static bool behavJoinable(uint32_t behav) {
+  Player *player = findPlayer(behav);
+  if(player != NULL) {
+    return !behavOneShot(behav) || spriteFramesShown(player->sprite) <= 1;
+  }
+  for(int i = 0; i < PLAYER_SLOTS; i++) {
+    if(players[i].users == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Put the Boris in the behaviour's player, starting a free one if nobody is
+// in it yet. fresh is set for a new player. Returns NULL when no player is
+// free or the behaviour couldn't be loaded
+static Player *joinPlayer(Boris *boris, uint32_t behav, bool *fresh) {
+  Player *player = findPlayer(behav);
+  *fresh = player == NULL;
+  for(int i = 0; player == NULL && i < PLAYER_SLOTS; i++) {
+    if(players[i].users == 0) {
+      player = &players[i];
+    }
+  }
+  if(player == NULL) {
+    return NULL;
+  }
+  if(*fresh) {
+    Sprite *sprite = getBehav(behav);
+    if(sprite == NULL) {
+      return NULL;
+    }
+    GBitmap *canvas = spriteCanvas(sprite, player->canvas);
+#if defined(PBL_BW)
+    GBitmap *flipped = player->flipped;
+    *player = (Player){ .behav = behav, .sprite = sprite, .canvas = canvas, .flipped = flipped };
+#else
+    *player = (Player){ .behav = behav, .sprite = sprite, .canvas = canvas };
+#endif
+    if(canvas == NULL) {
+      return NULL;
+    }
+    player->mirrored = (behavInfo(behav)->flags & BEHAV_MIRRORED) != 0;
+    // Make sure we start the animation from the beginning
+    spriteRestart(sprite);
+    if(!behavOneShot(behav)) {
+      player->ring = getFrameRing(behavInfo(behav)->resource, spriteFrameCount(sprite));
+    }
+  }
+  player->users++;
+  boris->player = player - players;
+  return player;
+}
+
+static void leavePlayer(Boris *boris) {
+  Player *player = borisPlayer(boris);
+  boris->player = NO_PLAYER;
+  if(player != NULL && --player->users == 0) {
+    player->frameDue = 0;
+    player->frame = NULL;
+  }
+}
+
+static void unloadPlayers() {
+  for(int i = 0; i < borisCount; i++) {
+    borises[i].player = NO_PLAYER;
+  }
+  for(int i = 0; i < PLAYER_SLOTS; i++) {
+    gbitmap_destroy(players[i].canvas);
+#if defined(PBL_BW)
+    gbitmap_destroy(players[i].flipped);
+#endif
+    players[i] = (Player){ 0 };
+  }
+}
+
+static GRect unionRect(GRect a, GRect b) {
+  int16_t left = a.origin.x < b.origin.x ? a.origin.x : b.origin.x;
+  int16_t top = a.origin.y < b.origin.y ? a.origin.y : b.origin.y;
+  int16_t right = a.origin.x + a.size.w > b.origin.x + b.size.w ? a.origin.x + a.size.w : b.origin.x + b.size.w;
+  int16_t bottom = a.origin.y + a.size.h > b.origin.y + b.size.h ? a.origin.y + a.size.h : b.origin.y + b.size.h;
+  return GRect(left, top, right - left, bottom - top);
+}
+
+// Fit the layer around every Boris with something to show and redraw it,
+// borisUpdateProc draws them all in one pass. Moving the layer invalidates
+// where they were and where they are now
+static void updateBorisLayer() {
+  GRect frame = GRectZero;
+  bool any = false;
+  for(int i = 0; i < borisCount; i++) {
+    Player *player = borisPlayer(&borises[i]);
+    if(player == NULL || player->frame == NULL) {
+      continue;
+    }
+    GRect rect = GRect(pixels(borises[i].x), pixels(borises[i].y), settings.borisSize, settings.borisSize);
+    frame = any ? unionRect(frame, rect) : rect;
+    any = true;
+  }
+  layer_set_frame(borisLayer, frame);
+  layer_mark_dirty(borisLayer);
+}
+
+// Follow the behaviour with the one the manifest says, or a random one
+static void pickNextBehav(Boris *boris) {
+  const BehavInfo *info = behavInfo(boris->behav);
+  if(info->next == BEHAV_NO_NEXT) {
+    changeBehaviour(boris, RANDOM, RANDOM);
+  } else {
+    changeBehaviour(boris, info->next, (info->flags & BEHAV_NEXT_ASLEEP) ? INFINITE : RANDOM);
+  }
+}
+
+static void changeAll(uint32_t newBehav, uint32_t duration) {
+  for(int i = 0; i < borisCount; i++) {
+    changeBehaviour(&borises[i], newBehav, duration);
+  }
+}
+
+// Every animation deadline goes through one AppTimer. Deadlines that fall
+// within SCHED_COALESCE_MS of each other are handled in the same wakeup,
+// for all players and Borises at once
+#define SCHED_COALESCE_MS 50
+
+static AppTimer *schedTimer;
+
+// While nobody is looking the scene is frozen. No timer runs, and deadlines
+// count from pausedAt until the scene resumes
+static bool paused;
+static uint64_t pausedAt;
+
+// Minimum time between drawn frames for each battery tier. When an animation
+// is faster than that, frames are dropped rather than slowed down. The energy
+// budget for behaviours is also scaled down as the battery runs low
+typedef struct BatteryTier {
+  uint8_t minCharge;
+  uint16_t frameMs;
+  uint8_t energyPercent;
+} BatteryTier;
+
+static const BatteryTier batteryTiers[] = {
+  { 50, 0, 100 },
+  { 30, 200, 75 },
+  { 10, 300, 50 },
+  { 0, 500, 30 }
+};
+
+// Battery saver caps the frame rate and the energy budget at least this much
+#define BATTERY_SAVER_FRAME_MS 300
+#define BATTERY_SAVER_ENERGY_PERCENT 50
+
+static uint16_t frameBudget;
+static uint8_t energyPercent = 100;
+
+static void updateBatteryTier(BatteryChargeState state) {
+  frameBudget = 0;
+  energyPercent = 100;
+  if(!state.is_charging) {
+    for(unsigned int i = 0; i < ARRAY_LENGTH(batteryTiers); i++) {
+      if(state.charge_percent >= batteryTiers[i].minCharge) {
+        frameBudget = batteryTiers[i].frameMs;
+        energyPercent = batteryTiers[i].energyPercent;
+        break;
+      }
+    }
+  }
+  if(settings.batterySaver) {
+    if(frameBudget < BATTERY_SAVER_FRAME_MS) {
+      frameBudget = BATTERY_SAVER_FRAME_MS;
+    }
+    if(energyPercent > BATTERY_SAVER_ENERGY_PERCENT) {
+      energyPercent = BATTERY_SAVER_ENERGY_PERCENT;
+    }
+  }
+}
+
+static uint64_t nowMs() {
+  time_t seconds;
+  uint16_t ms;
+  time_ms(&seconds, &ms);
+  return (uint64_t)seconds * 1000 + ms;
+}
+
+static uint64_t schedNow() {
+  return paused ? pausedAt : nowMs();
+}
+
+static void schedFire(void *data);
+
+static void earliest(uint64_t *due, uint64_t deadline) {
+  if(deadline != 0 && (*due == 0 || deadline < *due)) {
+    *due = deadline;
+  }
+}
+
+// (Re)arm the timer for the earliest pending deadline
+static void schedArm() {
+  uint64_t due = 0;
+  for(int i = 0; i < PLAYER_SLOTS; i++) {
+    earliest(&due, players[i].frameDue);
+  }
+  for(int i = 0; i < borisCount; i++) {
+    earliest(&due, borises[i].behavDue);
+  }
+  if(due == 0 || paused) {
+    if(schedTimer != NULL) {
+      app_timer_cancel(schedTimer);
+      schedTimer = NULL;
+    }
+    return;
+  }
+  uint64_t now = nowMs();
+  uint32_t delay = due > now ? (uint32_t)(due - now) : 0;
+  if(schedTimer == NULL || !app_timer_reschedule(schedTimer, delay)) {
+    schedTimer = app_timer_register(delay, schedFire, NULL);
+  }
+}
+
+// The player's one-shot showed its last frame, everyone in it moves on
+static void endPlayer(Player *player) {
+  bool users[BORIS_MAX];
+  for(int i = 0; i < borisCount; i++) {
+    users[i] = borisPlayer(&borises[i]) == player;
+  }
+  for(int i = 0; i < borisCount; i++) {
+    if(users[i]) {
+      pickNextBehav(&borises[i]);
+    }
+  }
+}
+
+static void schedFire(void *data) {
+  schedTimer = NULL;
+  PERF_WAKEUP();
+  uint64_t horizon = nowMs() + SCHED_COALESCE_MS;
+  // A behaviour change replaces any frame that was also due. A player that
+  // was started by one has a new deadline and waits for it
+  uint64_t frameDue[PLAYER_SLOTS];
+  for(int i = 0; i < PLAYER_SLOTS; i++) {
+    frameDue[i] = players[i].frameDue;
+  }
+  for(int i = 0; i < borisCount; i++) {
+    Boris *boris = &borises[i];
+    if(boris->behavDue != 0 && boris->behavDue <= horizon) {
+      boris->behavDue = 0;
+      pickNextBehav(boris);
+    }
+  }
+  for(int i = 0; i < PLAYER_SLOTS; i++) {
+    Player *player = &players[i];
+    if(player->frameDue != 0 && player->frameDue <= horizon && player->frameDue == frameDue[i]) {
+      player->frameDue = 0;
+      if(player->ends) {
+        endPlayer(player);
+      } else {
+        nextFrame(player);
+      }
+    }
+  }
+  schedArm();
+}
+
+// Show the player's next frame after delay ms, or end the behaviour if it's
+// a one-shot that just showed its last frame
+static void scheduleFrame(Player *player, uint32_t delay, bool ends) {
+  player->frameDue = schedNow() + delay;
+  player->ends = ends;
+  schedArm();
+}
+
+static void scheduleBehav(Boris *boris, uint32_t duration) {
+  boris->behavDue = schedNow() + duration;
+  schedArm();
+}
+
+static void schedCancel() {
+  for(int i = 0; i < PLAYER_SLOTS; i++) {
+    players[i].frameDue = 0;
+  }
+  for(int i = 0; i < borisCount; i++) {
+    borises[i].behavDue = 0;
+  }
+  schedArm();
+}
+
+// Viewer presence, when the WristPause setting is on. Nobody is looking
+// while the watch lies face down or hasn't moved for STILL_MS, then the
+// scene freezes until a tap or a flick of the wrist. The accelerometer is
+// only sampled while Boris plays, at 10 Hz in batches of ACCEL_BATCH_SAMPLES
+// so it wakes the watch every 2.5 seconds rather than on every sample
+#define ACCEL_BATCH_SAMPLES 25
+#define STILL_MS (30 * 1000)
+// Largest swing on any axis within a batch that still counts as still, in mG
+#define STILL_MOTION 60
+// Mean z beyond which the screen faces the ground, in mG
+#define FACE_DOWN_Z 800
+// Boris is only startled by someone who was away at least this long
+#define CAUGHT_YOU_MIN_MS (60 * 1000)
+
+static bool presenceOn;
+static bool watchingAccel;
+static uint64_t lastMotion;
+
+static void accelHandler(AccelData *data, uint32_t samples);
+
+static void watchAccel(bool watch) {
+  if(watch == watchingAccel) {
+    return;
+  }
+  watchingAccel = watch;
+  if(watch) {
+    accel_data_service_subscribe(ACCEL_BATCH_SAMPLES, accelHandler);
+    accel_service_set_sampling_rate(ACCEL_SAMPLING_10HZ);
+  } else {
+    accel_data_service_unsubscribe();
+  }
+}
+
+static void pauseScene() {
+  if(paused || !presenceOn) {
+    return;
+  }
+  paused = true;
+  pausedAt = nowMs();
+  schedArm();
+  watchAccel(false);
+}
+
+// Deadlines move on by the time spent paused, so Boris carries on where he
+// froze
+static void resumeScene() {
+  if(!paused) {
+    return;
+  }
+  uint64_t away = nowMs() - pausedAt;
+  paused = false;
+  for(int i = 0; i < PLAYER_SLOTS; i++) {
+    if(players[i].frameDue != 0) {
+      players[i].frameDue += away;
+    }
+  }
+  for(int i = 0; i < borisCount; i++) {
+    if(borises[i].behavDue != 0) {
+      borises[i].behavDue += away;
+    }
+    borises[i].movedAt += away;
+  }
+  lastMotion = nowMs();
+  watchAccel(presenceOn);
+  schedArm();
+}
+
+static void accelHandler(AccelData *data, uint32_t samples) {
+  PERF_WAKEUP();
+  int16_t low[3] = { INT16_MAX, INT16_MAX, INT16_MAX };
+  int16_t high[3] = { INT16_MIN, INT16_MIN, INT16_MIN };
+  int32_t sumZ = 0;
+  uint32_t used = 0;
+  for(uint32_t i = 0; i < samples; i++) {
+    // The vibration motor shakes the watch, that isn't the wearer moving
+    if(data[i].did_vibrate) {
+      continue;
+    }
+    const int16_t axes[3] = { data[i].x, data[i].y, data[i].z };
+    for(int axis = 0; axis < 3; axis++) {
+      low[axis] = axes[axis] < low[axis] ? axes[axis] : low[axis];
+      high[axis] = axes[axis] > high[axis] ? axes[axis] : high[axis];
+    }
+    sumZ += data[i].z;
+    used++;
+  }
+  if(used == 0) {
+    return;
+  }
+  uint64_t now = nowMs();
+  for(int axis = 0; axis < 3; axis++) {
+    if(high[axis] - low[axis] > STILL_MOTION) {
+      lastMotion = now;
+    }
+  }
+  if(sumZ / (int32_t)used > FACE_DOWN_Z || now - lastMotion >= STILL_MS) {
+    pauseScene();
+  }
+}
+
+static void tapHandler(AccelAxisType axis, int32_t direction) {
+  PERF_WAKEUP();
+  lastMotion = nowMs();
+  if(!paused) {
+    return;
+  }
+  uint64_t away = nowMs() - pausedAt;
+  resumeScene();
+  if(!settings.caughtYou || away < CAUGHT_YOU_MIN_MS) {
+    return;
+  }
+  // One-shots are left to finish, and sleeping Borises stay asleep
+  for(int i = 0; i < borisCount; i++) {
+    Boris *boris = &borises[i];
+    if(!borisAsleep(boris) && !behavOneShot(boris->behav)) {
+      changeBehaviour(boris, SCARE, RANDOM);
+    }
+  }
+}
+
+// Start or stop watching for viewers to match the setting
+static void updatePresence() {
+  if(settings.wristPause == presenceOn) {
+    return;
+  }
+  if(settings.wristPause) {
+    presenceOn = true;
+    lastMotion = nowMs();
+    accel_tap_service_subscribe(tapHandler);
+    watchAccel(true);
+  } else {
+    resumeScene();
+    presenceOn = false;
+    accel_tap_service_unsubscribe();
+    watchAccel(false);
+  }
+}
+
+static void stopPresence() {
+  if(presenceOn) {
+    accel_tap_service_unsubscribe();
+    presenceOn = false;
+  }
+  watchAccel(false);
+  paused = false;
+}
+
+// Everything the Borises play is paid for from one rolling energy budget in
+// the units of the behaviour costs in behavInfos. It refills at
+// ENERGY_PER_HOUR, scaled by the battery tier, and holds at most
+// ENERGY_CAPACITY. A random pick has to be affordable in full, so no hour
+// uses more than the hourly budget plus the capacity, however many Borises
+// there are. Borises sharing a player are drawn in the same redraws, so a
+// Boris who joins one only pays for keeping it going longer
+#define ENERGY_PER_HOUR 1200000
+#define ENERGY_CAPACITY (ENERGY_PER_HOUR / 4)
+#define MS_PER_HOUR (60 * 60 * 1000)
+
+// Resting never lasts shorter or longer than this
+#define REST_MS_MIN LOOP_MS_MIN
+#define REST_MS_MAX (60 * 1000)
+
+static int32_t energyLeft = ENERGY_CAPACITY;
+static uint64_t energyRefilled;
+
+static uint32_t energyPerHour() {
+  return (uint32_t)ENERGY_PER_HOUR / 100 * energyPercent;
+}
+
+static void refillEnergy() {
+  uint64_t now = nowMs();
+  if(energyRefilled == 0 || now < energyRefilled) {
+    energyRefilled = now;
+    return;
+  }
+  // An hour refills more than the capacity, so a longer gap, like a
+  // watchface closed for days, can't overflow the sum
+  uint64_t elapsed = now - energyRefilled;
+  if(elapsed > MS_PER_HOUR) {
+    elapsed = MS_PER_HOUR;
+  }
+  uint32_t gained = elapsed * energyPerHour() / MS_PER_HOUR;
+  if(gained == 0) {
+    return;
+  }
+  energyRefilled = now;
+  energyLeft = energyLeft + (int32_t)gained > ENERGY_CAPACITY ? ENERGY_CAPACITY : energyLeft + (int32_t)gained;
+}
+
+// Behaviours Boris is forced into are paid for as well, they can overdraw
+static void spendEnergy(uint32_t cost) {
+  energyLeft -= cost;
+}
+
+// The cost of keeping the player's loop going for duration from now. Only
+// the time past what is already paid for counts
+static uint32_t loopCost(Player *player, uint32_t duration) {
+  uint64_t now = nowMs();
+  uint64_t from = player->paidUntil > now ? player->paidUntil : now;
+  if(now + duration <= from) {
+    return 0;
+  }
+  player->paidUntil = now + duration;
+  return behavRate(player->behav) * (player->paidUntil - from) / 1000;
+}
+
+// The most a random pick of the behaviour can cost, including whatever
+// always follows it, like the shower after a weewee
+static uint32_t pickCost(uint32_t behav) {
+  uint32_t cost;
+  if(behavOneShot(behav)) {
+    cost = behavInfo(behav)->cost;
+  } else {
+    cost = behavRate(behav) * (settings.batterySaver ? LOOP_MS_MAX * 2 : LOOP_MS_MAX) / 1000;
+  }
+  if(behavInfo(behav)->next != BEHAV_NO_NEXT) {
+    cost += pickCost(behavInfo(behav)->next);
+  }
+  return cost;
+}
+
+// Pick a random behaviour by fun weight. As the budget runs down, behaviours
+// that use energy faster than the budget refills are scaled down toward
+// budget rate / their rate, so cheap ones take over. Behaviours with no
+// weight, or that no player is free for, are left out. Returns REST and
+// sets restMs when nothing is affordable
+static uint32_t pickBehav(uint32_t *restMs) {
+  refillEnergy();
+  uint32_t budgetRate = energyPerHour() / (MS_PER_HOUR / 1000);
+  uint32_t left = energyLeft > 0 ? energyLeft : 0;
+  uint32_t weights[BEHAV_COUNT];
+  uint32_t total = 0;
+  uint32_t cheapest = UINT32_MAX;
+  for(int i = 0; i < BEHAV_COUNT; i++) {
+    weights[i] = 0;
+    if(behavInfo(i)->weight == 0) {
+      continue;
+    }
+    uint32_t cost = pickCost(i);
+    uint32_t rate = behavOneShot(i) ? cost * 1000 / behavInfo(i)->ms : behavRate(i);
+    if(cost < cheapest) {
+      cheapest = cost;
+    }
+    if(cost > left || !behavJoinable(i)) {
+      continue;
+    }
+    weights[i] = behavInfo(i)->weight * 256;
+    if(rate > budgetRate) {
+      uint64_t scaled = (uint64_t)budgetRate * ENERGY_CAPACITY + (uint64_t)(rate - budgetRate) * left;
+      weights[i] = weights[i] * scaled / ((uint64_t)rate * ENERGY_CAPACITY);
+    }
+    total += weights[i];
+  }
+  if(total == 0) {
+    // Stand still until the cheapest behaviour is affordable again
+    uint32_t wait = budgetRate > 0 && cheapest > left ? (cheapest - left) * 1000 / budgetRate : REST_MS_MIN;
+    *restMs = wait < REST_MS_MIN ? REST_MS_MIN : wait > REST_MS_MAX ? REST_MS_MAX : wait;
+    return REST;
+  }
+  uint32_t pick = rand() % total;
+  for(int i = 0; i < BEHAV_COUNT; i++) {
+    if(pick < weights[i]) {
+      return i;
+    }
+    pick -= weights[i];
+  }
+  return STANDING;
+}
+
+// Move Boris as far as his behaviour takes him since he was last moved. Only
+// the walks move, and a resting Boris stands still
+static void moveBoris(Boris *boris) {
+  uint64_t now = schedNow();
+  uint32_t elapsed = now - boris->movedAt;
+  boris->movedAt = now;
+  if(boris->resting || boris->player == NO_PLAYER) {
+    return;
+  }
+  const BehavInfo *info = behavInfo(boris->behav);
+  boris->x += (int64_t)info->vx * elapsed / 1000;
+  boris->y += (int64_t)info->vy * elapsed / 1000;
+
+  // Make sure Boris doesn't get too far out of bounds
+  // Values are minutely adjusted for the empty space around the Boris sprites
+  int32_t minX = toFixed(- settings.borisSize + 5);
+  int32_t minY = toFixed(- settings.borisSize);
+  int32_t maxX = toFixed(screenSize.w - 5);
+  int32_t maxY = toFixed(screenSize.h - 3);
+  if(boris->x < minX || boris->x > maxX ||
+     boris->y < minY || boris->y > maxY) {
+    if(boris->x < minX) {
+      boris->x = maxX;
+    }
+    if(boris->x > maxX) {
+      boris->x = minX;
+    }
+    if(boris->y < minY) {
+      boris->y = maxY;
+    }
+    if(boris->y > maxY) {
+      boris->y = minY;
+    }
+  }
+}
+
+static void changeBehaviour(Boris *boris, uint32_t newBehav, uint32_t duration) {
+  // Finish the current walk, then leave the behaviour and cancel his
+  // pending behaviour change
+  moveBoris(boris);
+  leavePlayer(boris);
+  boris->behavDue = 0;
+
+  // Choose a random behaviour unless one is specified
+  boris->resting = false;
+  if(newBehav == RANDOM) {
+    newBehav = pickBehav(&duration);
+  }
+  if(newBehav == REST) {
+    newBehav = STANDING;
+    boris->resting = true;
+  }
+  //newBehav = GIFTWRAP; // Uncomment to test certain behaviour
+  boris->behav = newBehav;
+  bool fresh;
+  Player *player = joinPlayer(boris, boris->behav, &fresh);
+  if(player == NULL && boris->behav != STANDING) {
+    // Out of memory or players, fall back to a pinned behaviour
+    APP_LOG(APP_LOG_LEVEL_ERROR, "Couldn't load behaviour %d", (int)boris->behav);
+    boris->behav = STANDING;
+    player = joinPlayer(boris, boris->behav, &fresh);
+  }
+  if(player == NULL) {
+    // Nothing to show him with, try again in a while
+    scheduleBehav(boris, REST_MS_MIN);
+    updateBorisLayer();
+    return;
+  }
+  refillEnergy();
+  if(behavOneShot(boris->behav)) {
+    // Whoever joins sees the same play
+    if(fresh) {
+      spendEnergy(behavInfo(boris->behav)->cost);
+    }
+  } else if(boris->behav == SLEEPING && duration == INFINITE) {
+    // Sleep until woken up, breathing once a minute from tickHandler
+    player->asleep = true;
+    player->frameDue = 0;
+  } else if(boris->resting) {
+    // A single frame until the budget has refilled, unless he shows the
+    // frame of a Boris already standing
+    if(fresh) {
+      spendEnergy(behavInfo(STANDING)->cost / behavInfo(STANDING)->frames);
+    }
+    scheduleBehav(boris, duration);
+  } else {
+    // Set timeout for next behaviour change
+    if(duration == RANDOM) {
+      duration = LOOP_MS_MIN + rand() % (LOOP_MS_MAX - LOOP_MS_MIN);
+      if(settings.batterySaver) {
+        duration *= 2;
+      }
+    }
+    if(duration != INFINITE) {
+      spendEnergy(loopCost(player, duration));
+      scheduleBehav(boris, duration);
+    }
+  }
+
+  // Start the animation, or just show him in the one that's running
+  if(fresh || (player->frameDue == 0 && !player->asleep && !boris->resting)) {
+    nextFrame(player);
+  } else {
+    updateBorisLayer();
+  }
+  // Nobody needs to watch sleeping Borises breathe, a tap shows them again
+  if(allAsleep()) {
+    pauseScene();
+  }
+}
+
+// Has the player's one-shot behaviour shown its last frame?
+static bool behavFinished(const Player *player) {
+  return behavOneShot(player->behav) && spriteFramesShown(player->sprite) >= spriteFrameCount(player->sprite);
+}
+
+// Advance the player's animation by one frame without drawing it. Returns
+// false if the animation has no frames left
+static bool advanceFrame(Player *player, const GBitmap **frame, uint32_t *delay) {
+  FrameRing *ring = player->ring;
+  if(ring != NULL && !ring->failed && ring->filled == ring->count) {
+    // The whole loop is already decoded, just pick the next one
+    *delay = ring->delays[player->ringFrame];
+    *frame = framePool[ring - frameRings][player->ringFrame];
+    player->ringFrame = (player->ringFrame + 1) % ring->count;
+  } else if(spriteNextFrame(player->sprite, player->canvas, delay)) {
+    // Advance to the next sprite frame, and get the delay for this frame
+    *frame = player->canvas;
+    // Keep it if we are filling a ring for this loop
+    if(ring != NULL && !ring->failed && ring->filled == player->ringFrame) {
+      storeRingFrame(ring, player->canvas, player->ringFrame, *delay);
+    }
+    player->ringFrame = (player->ringFrame + 1) % spriteFrameCount(player->sprite);
+  } else {
+    return false;
+  }
+  return true;
+}
+
+#if defined(PBL_BW)
+// graphics_draw_bitmap_in_rect can't flip, so on black and white screens a
+// mirrored frame is flipped into the player's own bitmap first. Shows it
+// unflipped if that bitmap can't be had
+static const GBitmap *mirrorFrame(Player *player, const GBitmap *frame) {
+  GBitmapFormat format = gbitmap_get_format(frame);
+  GSize size = gbitmap_get_bounds(frame).size;
+  if(player->flipped != NULL) {
+    GSize flippedSize = gbitmap_get_bounds(player->flipped).size;
+    if(gbitmap_get_format(player->flipped) != format || !gsize_equal(&size, &flippedSize)) {
+      gbitmap_destroy(player->flipped);
+      player->flipped = NULL;
+    }
+  }
+  if(player->flipped == NULL) {
+    player->flipped = format == GBitmapFormat8Bit ? gbitmap_create_blank(size, format) :
+      gbitmap_create_blank_with_palette(size, format, gbitmap_get_palette(frame), false);
+    if(player->flipped == NULL) {
+      return frame;
+    }
+  } else if(format != GBitmapFormat8Bit) {
+    // Ring frames and the canvas keep their own copies of the palette
+    gbitmap_set_palette(player->flipped, gbitmap_get_palette(frame), false);
+  }
+  blitMirror(player->flipped, frame);
+  return player->flipped;
+}
+#endif
+
+// Put the player's frame on screen at each of its Borises, wherever the time
+// since the last frame has taken them
+static void showFrame(Player *player, const GBitmap *frame) {
+  PERF_FRAME();
+#if defined(PBL_BW)
+  if(player->mirrored) {
+    frame = mirrorFrame(player, frame);
+  }
+#endif
+  player->frame = frame;
+  for(int i = 0; i < borisCount; i++) {
+    if(borisPlayer(&borises[i]) == player) {
+      moveBoris(&borises[i]);
+    }
+  }
+  updateBorisLayer();
+}
+
+static void nextFrame(Player *player)
+{
+  const GBitmap *frame = NULL;
+  uint32_t delay;
+  uint32_t elapsed = 0;
+  bool ended = false;
+  PERF_SLOT(player->behav);
+  PERF_START(decodeStart);
+
+  if(player->asleep || !playerActive(player)) {
+    // Asleep shows one frame per minute tick, resting a single frame. No timers
+    if(advanceFrame(player, &frame, &delay)) {
+      PERF_DECODE(decodeStart);
+      showFrame(player, frame);
+    }
+    return;
+  }
+
+  // If the battery tier allows fewer frames than the animation has, skip
+  // frames so the animation keeps its speed
+  do {
+    if(!advanceFrame(player, &frame, &delay)) {
+      ended = true;
+      break;
+    }
+    elapsed += delay;
+    ended = behavFinished(player);
+  } while(elapsed < frameBudget && !ended);
+  PERF_DECODE(decodeStart);
+
+  if(frame != NULL) {
+    showFrame(player, frame);
+  }
+
+  // Wait for the frame's delay before showing the next one
+  scheduleFrame(player, elapsed, ended);
+}
 
-#define NOOFBEHAVS 18
-
-#define WALKLEFT 0
-#define WALKRIGHT 1
-#define WALKUP 2
-#define WALKDOWN 3
-#define STANDING 4
-#define SLEEPING 5
-#define SHREDDING 6
-#define EATING 7
-#define INVADERS 8
-#define COFFEE 9
-#define SHOWER 10
-#define READPAPER 11
-#define SCARE 12
-#define SUNGLASSES 13
-#define TONGUEOUT 14
-#define WEEWEE 15
-#define BALLOON 16
-#define GIFTWRAP 17
-
-// Specials
-#define GOTOSLEEP 42
-#define GETUP 43
-
-void loadBehavs() {
-  bhStanding = gbitmap_sequence_create_with_resource(RESOURCE_ID_STANDING);
-  bhSleeping = gbitmap_sequence_create_with_resource(RESOURCE_ID_SLEEPING);
-  bhWalkLeft = gbitmap_sequence_create_with_resource(RESOURCE_ID_WALKLEFT);
-  bhWalkRight = gbitmap_sequence_create_with_resource(RESOURCE_ID_WALKRIGHT);
-  bhWalkDown = gbitmap_sequence_create_with_resource(RESOURCE_ID_WALKDOWN);
-  bhWalkUp = gbitmap_sequence_create_with_resource(RESOURCE_ID_WALKUP);
-  bhShredding = gbitmap_sequence_create_with_resource(RESOURCE_ID_SHREDDING);
-  bhEating = gbitmap_sequence_create_with_resource(RESOURCE_ID_EATING);
-  bhInvaders = gbitmap_sequence_create_with_resource(RESOURCE_ID_INVADERS);
-  bhCoffee = gbitmap_sequence_create_with_resource(RESOURCE_ID_COFFEE);
-  bhShower = gbitmap_sequence_create_with_resource(RESOURCE_ID_SHOWER);
-  bhReadPaper = gbitmap_sequence_create_with_resource(RESOURCE_ID_READPAPER);
-  bhGoToSleep = gbitmap_sequence_create_with_resource(RESOURCE_ID_GOTOSLEEP);
-  bhGetUp = gbitmap_sequence_create_with_resource(RESOURCE_ID_GETUP);
-  bhScare = gbitmap_sequence_create_with_resource(RESOURCE_ID_SCARE);
-  bhSunglasses = gbitmap_sequence_create_with_resource(RESOURCE_ID_SUNGLASSES);
-  bhTongueOut = gbitmap_sequence_create_with_resource(RESOURCE_ID_TONGUEOUT);
-  bhWeeWee = gbitmap_sequence_create_with_resource(RESOURCE_ID_WEEWEE);
-  bhBalloon = gbitmap_sequence_create_with_resource(RESOURCE_ID_BALLOON);
-  bhGiftWrap = gbitmap_sequence_create_with_resource(RESOURCE_ID_GIFTWRAP);
-}
-
-static void nextFrame();
-static void changeBehaviour(uint32_t newBehav, uint32_t duration);
-
-// Persistent storage key
-#define SETTINGS_KEY 1
+// Send Borises out or call them back to match the BorisCount setting. New
+// ones turn up somewhere random, asleep if the others are
+static void updateBorisCount() {
+  uint8_t count = settings.borisCount < 1 ? 1 : settings.borisCount > BORIS_MAX ? BORIS_MAX : settings.borisCount;
+  while(borisCount > count) {
+    Boris *boris = &borises[--borisCount];
+    leavePlayer(boris);
+    boris->behavDue = 0;
+  }
+  bool sleepy = allAsleep();
+  while(borisCount < count) {
+    Boris *boris = &borises[borisCount++];
+    *boris = (Boris){
+      .x = toFixed(rand() % (screenSize.w - settings.borisSize)),
+      .y = toFixed(rand() % (screenSize.h - settings.borisSize)),
+      .player = NO_PLAYER,
+      .movedAt = schedNow()
+    };
+    if(sleepy) {
+      changeBehaviour(boris, SLEEPING, INFINITE);
+    } else {
+      changeBehaviour(boris, RANDOM, RANDOM);
+    }
+  }
+  updateBorisLayer();
+  schedArm();
+}
 
-// Define our settings struct
-typedef struct AppSettings {
-  GColor bgColor;
-  uint32_t state;
-  int borisX;
-  int borisY;
-  int borisSize;
-  char *borisBedtime;
-  char *borisGetUpTime;
-  bool batterySaver;
-} AppSettings;
+// Last weather reading from the phone, weatherAt is 0 until there is one
+static int8_t weatherTemperature;
+static uint8_t weatherIcon;
+static time_t weatherAt;
+
+// Hourly forecast from the phone. The watch moves the weather on to the next
+// hour's reading by itself, and only asks the phone for a new forecast when
+// fewer than FORECAST_REFRESH_HOURS are left. It is kept in persistent
+// storage, so it carries on while the phone is out of reach
+#define FORECAST_HOUR (60 * 60)
+#define FORECAST_REFRESH_HOURS 18
+
+typedef struct Forecast {
+  time_t start;
+  // Hours in the forecast, 0 if there is none
+  uint8_t count;
+  int8_t temperatures[FORECAST_SLOTS];
+  uint8_t icons[FORECAST_SLOTS];
+} Forecast;
+
+static Forecast forecast;
+
+// Get the forecast's reading for the hour now falls in. Returns false if the
+// forecast doesn't cover now
+static bool forecastAt(time_t now, int8_t *temperature, uint8_t *icon) {
+  if(forecast.count == 0 || now < forecast.start || now >= forecast.start + forecast.count * FORECAST_HOUR) {
+    return false;
+  }
+  uint32_t hour = (now - forecast.start) / FORECAST_HOUR;
+  *temperature = forecast.temperatures[hour];
+  *icon = forecast.icons[hour];
+  return true;
+}
 
-static AppSettings settings;
+// Is it time to ask for a new forecast?
+static bool forecastRunningOut(time_t now) {
+  return forecast.count == 0 ||
+         forecast.start + forecast.count * FORECAST_HOUR - now < FORECAST_REFRESH_HOURS * FORECAST_HOUR;
+}
 
-static void defaultSettings() {
-  settings.bgColor = GColorDarkGreen;
-  settings.state = STANDING;
-  settings.borisX = 60;
-  settings.borisY = 90;
-  settings.borisSize = 32;
-  settings.borisBedtime = "22:00";
-  settings.borisGetUpTime = "08:00";
-  settings.batterySaver = false;
+// Read the stored forecast, and take the weather from it if it covers now
+static void loadForecast() {
+  if(persist_read_data(FORECAST_KEY, &forecast, sizeof(forecast)) != (int)sizeof(forecast) ||
+     forecast.count > FORECAST_SLOTS) {
+    forecast.count = 0;
+    return;
+  }
+  time_t now = time(NULL);
+  if(forecastAt(now, &weatherTemperature, &weatherIcon)) {
+    weatherAt = now;
+  }
 }
 
-// Read settings from persistent storage
-static void loadSettings() {
-  // Load the default settings
-  defaultSettings();
-  // Read settings from persistent storage, if they exist
-  persist_read_data(SETTINGS_KEY, &settings, sizeof(settings));
+// The scene is saved when the watchface closes and picked up again when it
+// opens, so a notification or a quick look at another app doesn't reshuffle
+// the Borises or blank the weather. Bump SCENE_VERSION when the layout
+// changes, older snapshots are then ignored
+#define SCENE_VERSION 2
+// A saved weather reading older than this isn't shown
+#define WEATHER_MAX_AGE (3 * 60 * 60)
+
+typedef struct SavedBoris {
+  int32_t x;
+  int32_t y;
+  uint8_t behav;
+  // Next frame of his player's animation, see Player.ringFrame
+  uint8_t frame;
+  bool resting;
+  bool asleep;
+  // Until his next behaviour change, 0 if the behaviour ends by itself
+  uint32_t behavLeft;
+} SavedBoris;
+
+typedef struct Scene {
+  uint8_t version;
+  uint8_t borisCount;
+  int8_t temperature;
+  uint8_t icon;
+  time_t weatherAt;
+  SavedBoris borises[BORIS_MAX];
+} Scene;
+
+// Snapshot read at launch, version is 0 if there was none
+static Scene savedScene;
+
+static void loadScene() {
+  if(persist_read_data(SCENE_KEY, &savedScene, sizeof(savedScene)) != (int)sizeof(savedScene) ||
+     savedScene.version != SCENE_VERSION ||
+     savedScene.borisCount < 1 || savedScene.borisCount > BORIS_MAX) {
+    savedScene.version = 0;
+    return;
+  }
+  if(savedScene.weatherAt != 0 && time(NULL) - savedScene.weatherAt < WEATHER_MAX_AGE) {
+    weatherTemperature = savedScene.temperature;
+    weatherIcon = savedScene.icon;
+    weatherAt = savedScene.weatherAt;
+  }
 }
 
-// Save the settings to persistent storage
-static void saveSettings() {
-  persist_write_data(SETTINGS_KEY, &settings, sizeof(settings));
+static void saveScene() {
+  Scene scene = {
+    .version = SCENE_VERSION,
+    .borisCount = borisCount,
+    .temperature = weatherTemperature,
+    .icon = weatherIcon,
+    .weatherAt = weatherAt
+  };
+  uint64_t now = schedNow();
+  for(int i = 0; i < borisCount; i++) {
+    Boris *boris = &borises[i];
+    Player *player = borisPlayer(boris);
+    scene.borises[i] = (SavedBoris){
+      .x = boris->x,
+      .y = boris->y,
+      .behav = boris->behav,
+      .frame = player != NULL ? player->ringFrame : 0,
+      .resting = boris->resting,
+      .asleep = player != NULL && player->asleep,
+      .behavLeft = boris->behavDue > now ? boris->behavDue - now : 0
+    };
+  }
+  persist_write_data(SCENE_KEY, &scene, sizeof(scene));
 }
 
-static void pickNextBehav() {
-  switch(settings.state) {
-    case GOTOSLEEP:
-      changeBehaviour(SLEEPING, INFINITE);
-    break;
-    case GETUP:
-      changeBehaviour(SHOWER, RANDOM);
-    break;
-    case WEEWEE:
-      changeBehaviour(SHOWER, RANDOM);
-    break;
-    default:
-      changeBehaviour(RANDOM, RANDOM);
+// Fast forward a player to the frame it was at. The frames in between are
+// decoded but not shown
+static void seekPlayer(Player *player, uint8_t frame) {
+  uint32_t count = spriteFrameCount(player->sprite);
+  uint32_t skip = (frame + count - player->ringFrame) % count;
+  const GBitmap *shown = NULL;
+  uint32_t delay = 0;
+  for(uint32_t i = 0; i < skip && advanceFrame(player, &shown, &delay); i++) {
+  }
+  if(shown == NULL) {
+    return;
+  }
+  showFrame(player, shown);
+  if(player->frameDue != 0) {
+    scheduleFrame(player, delay, behavFinished(player));
   }
 }
 
-static void changeBehaviour(uint32_t newBehav, uint32_t duration) {
-  // Cancel any timers
-  app_timer_cancel(behavTimer);
-  app_timer_cancel(frameTimer);
-  
-  // Choose a random behaviour unless one is specified
-  if(newBehav != RANDOM) {
-    settings.state = newBehav;
-  } else {
-    // Choose a walking behaviour more often than others
-    if(rand() % 3 == 0) {
-      settings.state = rand() % 4;
+// Fast forward the players restoreScene() started. This can take dozens of
+// reads, so it is left to a startup slice and they show their first frame
+// until then
+static void seekPlayers() {
+  for(int i = 0; i < PLAYER_SLOTS; i++) {
+    if(players[i].users > 0 && players[i].seeking) {
+      players[i].seeking = false;
+      seekPlayer(&players[i], players[i].seekFrame);
+    }
+  }
+}
+
+// Put the saved Borises back in their behaviours, with the time they had
+// left in them. Returns false if there is no snapshot
+static bool restoreScene() {
+  if(savedScene.version != SCENE_VERSION) {
+    return false;
+  }
+  borisCount = savedScene.borisCount;
+  for(int i = 0; i < borisCount; i++) {
+    const SavedBoris *saved = &savedScene.borises[i];
+    Boris *boris = &borises[i];
+    *boris = (Boris){ .x = saved->x, .y = saved->y, .behav = saved->behav, .player = NO_PLAYER,
+                      .movedAt = schedNow() };
+    uint32_t behav = saved->behav < BEHAV_COUNT ? saved->behav : RANDOM;
+    if(saved->asleep) {
+      changeBehaviour(boris, SLEEPING, INFINITE);
+    } else if(saved->resting) {
+      changeBehaviour(boris, REST, saved->behavLeft != 0 ? saved->behavLeft : REST_MS_MIN);
     } else {
-      settings.state = rand() % NOOFBEHAVS;
+      changeBehaviour(boris, behav, saved->behavLeft != 0 ? saved->behavLeft : RANDOM);
+    }
+    // Only the Boris who started the player moves it on
+    Player *player = borisPlayer(boris);
+    if(player != NULL && player->users == 1 && player->behav == behav) {
+      player->seeking = true;
+      player->seekFrame = saved->frame;
     }
   }
-  //settings.borisX = 70;
-  //settings.borisY= 90;
-  //settings.state = GIFTWRAP; // Uncomment to test certain behaviour
-  switch(settings.state) {
-    case STANDING:
-      curBehav = bhStanding;
-    break;
-    case SLEEPING:
-      curBehav = bhSleeping;
-    break;
-    case WALKLEFT:
-      curBehav = bhWalkLeft;
-    break;
-    case WALKRIGHT:
-      curBehav = bhWalkRight;
-    break;
-    case WALKDOWN:
-      curBehav = bhWalkDown;
-    break;
-    case WALKUP:
-      curBehav = bhWalkUp;
-    break;
-    case SHREDDING:
-      curBehav = bhShredding;
-    break;
-    case EATING:
-      curBehav = bhEating;
-    break;
-    case INVADERS:
-      curBehav = bhInvaders;
-    break;
-    case COFFEE:
-      curBehav = bhCoffee;
-    break;
-    case SHOWER:
-      curBehav = bhShower;
-    break;
-    case READPAPER:
-      curBehav = bhReadPaper;
-    break;
-    case GOTOSLEEP:
-      curBehav = bhGoToSleep;
-    break;
-    case GETUP:
-      curBehav = bhGetUp;
-    break;
-    case SCARE:
-      curBehav = bhScare;
-    break;
-    case SUNGLASSES:
-      curBehav = bhSunglasses;
-    break;
-    case TONGUEOUT:
-      curBehav = bhTongueOut;
-    break;
-    case WEEWEE:
-      curBehav = bhWeeWee;
-    break;
-    case BALLOON:
-      curBehav = bhBalloon;
-    break;
-    case GIFTWRAP:
-      curBehav = bhGiftWrap;
-    break;
+  return true;
+}
+
+// The weather icons are packed into a single sprite sheet at build time by
+// tools/weatheratlas.py, stacked vertically in the order 01d, 01n, 02d, 02n...
+#define WEATHER_ICON_SIZE 32
+
+// First atlas slot (the day icon) for each OpenWeatherMap condition number,
+// the night icon follows it
+static const int8_t weatherIconSlots[] = {
+  [0 ... 50] = -1,
+  [1] = 0,
+  [2] = 2,
+  [3] = 4,
+  [4] = 6,
+  [9] = 8,
+  [10] = 10,
+  [11] = 12,
+  [13] = 14,
+  [50] = 16
+};
+
+// Map a packet's icon byte, the OpenWeatherMap condition number with
+// PACKET_ICON_NIGHT set for night icons, to its atlas slot, or -1
+static int weatherIconIndex(uint8_t icon) {
+  int condition = icon & ~PACKET_ICON_NIGHT;
+  if(condition >= (int)ARRAY_LENGTH(weatherIconSlots) || weatherIconSlots[condition] < 0) {
+    return -1;
+  }
+  return weatherIconSlots[condition] + ((icon & PACKET_ICON_NIGHT) ? 1 : 0);
+}
+
+// Show an atlas slot. One sub-bitmap view of the atlas is created and moved
+// to the current icon from then on
+static void setWeatherIcon(int index) {
+  if(index < 0 || weatherIcons == NULL) {
+    return;
   }
-  // Make sure we start the animation from the beginning
-  gbitmap_sequence_restart(curBehav);
-  if(gbitmap_sequence_get_total_num_frames(curBehav) >= 20 || settings.state >= 42) {
-    oneShot = true;
+  GRect slot = GRect(0, index * WEATHER_ICON_SIZE, WEATHER_ICON_SIZE, WEATHER_ICON_SIZE);
+  if(weatherBitmap == NULL) {
+    weatherBitmap = gbitmap_create_as_sub_bitmap(weatherIcons, slot);
+    if(weatherBitmap == NULL) {
+      return;
+    }
+    bitmap_layer_set_bitmap(weatherIconLayer, weatherBitmap);
   } else {
-    oneShot = false;
-    // Set timeout for next behaviour change
-    if(duration != RANDOM) {
-      if(duration != INFINITE) {
-        behavTimer = app_timer_register(duration, pickNextBehav, NULL);
-      }
+    gbitmap_set_bounds(weatherBitmap, slot);
+  }
+  layer_mark_dirty(bitmap_layer_get_layer(weatherIconLayer));
+}
+
+// The clock, date and temperature are drawn with their shadow into cached
+// bitmaps only when the text changes. Every other redraw just blits those.
+// Black and white screens keep a black background, where the shadow would
+// only show over Boris, so they leave it out and cache one bit per pixel
+#if defined(PBL_BW)
+#define TEXT_SHADOW_OFFSET 0
+#else
+#define TEXT_SHADOW_OFFSET 4
+#endif
+
+enum {
+  TEXT_TIME,
+  TEXT_DATE,
+  TEXT_WEATHER,
+  TEXT_COUNT
+};
+
+typedef struct CachedText {
+  GRect frame;
+  GFont font;
+  char text[16];
+  GRect area;
+  GBitmap *bitmap;
+  // Size the bitmap was created at. It is kept for as long as the text fits
+  GSize capacity;
+  bool stale;
+} CachedText;
+
+static CachedText texts[TEXT_COUNT];
+// Bytes held by all cached bitmaps, at most TEXT_CACHE_BYTES
+static uint32_t textCacheBytes;
+#if defined(PBL_BW)
+// Unset bits are transparent, set bits are the white text
+static GColor textPalette[2];
+#endif
+
+static uint32_t textBitmapBytes(GSize size) {
+#if defined(PBL_BW)
+  return (size.w + 7) / 8 * size.h;
+#else
+  return size.w * size.h;
+#endif
+}
+
+static void freeCachedBitmap(CachedText *cached) {
+  if(cached->bitmap != NULL) {
+    gbitmap_destroy(cached->bitmap);
+    cached->bitmap = NULL;
+    textCacheBytes -= textBitmapBytes(cached->capacity);
+  }
+}
+
+// Returns a bitmap of at least size for the text, reusing the one it has if
+// that is large enough, or NULL if it would take the cache over its budget
+static GBitmap *cachedBitmap(CachedText *cached, GSize size) {
+  if(cached->bitmap != NULL && (size.w > cached->capacity.w || size.h > cached->capacity.h)) {
+    freeCachedBitmap(cached);
+  }
+  if(cached->bitmap == NULL) {
+    if(textCacheBytes + textBitmapBytes(size) > TEXT_CACHE_BYTES) {
+      return NULL;
+    }
+#if defined(PBL_BW)
+    textPalette[0] = GColorClear;
+    textPalette[1] = GColorWhite;
+    cached->bitmap = gbitmap_create_blank_with_palette(size, GBitmapFormat1BitPalette, textPalette, false);
+#else
+    cached->bitmap = gbitmap_create_blank(size, GBitmapFormat8Bit);
+#endif
+    if(cached->bitmap == NULL) {
+      return NULL;
+    }
+    cached->capacity = size;
+    textCacheBytes += textBitmapBytes(size);
+  }
+  // Only the part the text covers is drawn
+  gbitmap_set_bounds(cached->bitmap, GRect(0, 0, size.w, size.h));
+  return cached->bitmap;
+}
+
+static void setCachedText(int i, const char *text) {
+  if(!strcmp(texts[i].text, text)) {
+    return;
+  }
+  snprintf(texts[i].text, sizeof(texts[i].text), "%s", text);
+  texts[i].stale = true;
+  layer_mark_dirty(textLayer);
+}
+
+// Show the last weather reading, or that we are still waiting for one
+static void showWeatherText() {
+  if(weatherAt == 0) {
+    setCachedText(TEXT_WEATHER, "Loading...");
+    return;
+  }
+  char temperatureBuffer[8];
+  snprintf(temperatureBuffer, sizeof(temperatureBuffer), "%dC", (int)weatherTemperature);
+  setCachedText(TEXT_WEATHER, temperatureBuffer);
+}
+
+// Show a new weather reading. Nothing is redrawn if it didn't change
+static void setWeather(int8_t temperature, uint8_t icon) {
+  bool changed = weatherAt == 0 || temperature != weatherTemperature || icon != weatherIcon;
+  weatherTemperature = temperature;
+  weatherIcon = icon;
+  weatherAt = time(NULL);
+  if(changed) {
+    showWeatherText();
+    setWeatherIcon(weatherIconIndex(weatherIcon));
+  }
+}
+
+static void drawShadowedText(GContext *ctx, CachedText *cached) {
+#if !defined(PBL_BW)
+  GRect shadowFrame = cached->frame;
+  shadowFrame.origin.y += TEXT_SHADOW_OFFSET;
+  graphics_context_set_text_color(ctx, GColorBlack);
+  graphics_draw_text(ctx, cached->text, cached->font, shadowFrame,
+                     GTextOverflowModeWordWrap, GTextAlignmentLeft, NULL);
+#endif
+  graphics_context_set_text_color(ctx, GColorWhite);
+  graphics_draw_text(ctx, cached->text, cached->font, cached->frame,
+                     GTextOverflowModeWordWrap, GTextAlignmentLeft, NULL);
+}
+
+#if defined(PBL_BW)
+// The watch's framebuffer has one bit per pixel, least significant first.
+// Any other is 8-bit, like the host simulator's
+static bool framebufferWhite(const uint8_t *row, GBitmapFormat format, int x) {
+  if(format == GBitmapFormat1Bit) {
+    return (row[x / 8] >> (x % 8)) & 1;
+  }
+  return row[x] == GColorWhite.argb;
+}
+
+static void setFramebufferPixel(uint8_t *row, GBitmapFormat format, int x, bool white) {
+  if(format == GBitmapFormat1Bit) {
+    if(white) {
+      row[x / 8] |= 1 << (x % 8);
     } else {
-      if(settings.batterySaver) {
-        behavTimer = app_timer_register(((rand() % 4000) + 4000) * 2, pickNextBehav, NULL);
+      row[x / 8] &= ~(1 << (x % 8));
+    }
+  } else {
+    row[x] = white ? GColorWhite.argb : GColorBlack.argb;
+  }
+}
+
+// The cache's palettized rows are most significant bit first
+static bool cacheBit(const uint8_t *row, int x) {
+  return (row[x / 8] >> (7 - x % 8)) & 1;
+}
+
+static void setCacheBit(uint8_t *row, int x, bool set) {
+  if(set) {
+    row[x / 8] |= 1 << (7 - x % 8);
+  } else {
+    row[x / 8] &= ~(1 << (7 - x % 8));
+  }
+}
+#endif
+
+// Render the text into its cached bitmap. There is no offscreen context, so
+// the text is drawn into the framebuffer over the background colour, copied
+// out with the background made transparent, and whatever was underneath is
+// put back. The cached bitmap holds the saved pixels in the meantime
+static void renderCachedText(GContext *ctx, CachedText *cached, GRect bounds) {
+  GSize size = graphics_text_layout_get_content_size(cached->text, cached->font,
+                                                     GRect(0, 0, cached->frame.size.w, cached->frame.size.h),
+                                                     GTextOverflowModeWordWrap, GTextAlignmentLeft);
+  if(size.h > cached->frame.size.h) {
+    size.h = cached->frame.size.h;
+  }
+  GRect area = GRect(cached->frame.origin.x, cached->frame.origin.y, size.w, size.h + TEXT_SHADOW_OFFSET);
+  grect_clip(&area, &bounds);
+  cached->area = area;
+  cached->stale = false;
+  if(area.size.w <= 0 || area.size.h <= 0) {
+    return;
+  }
+  GBitmap *fb = cachedBitmap(cached, area.size) != NULL ? graphics_capture_frame_buffer(ctx) : NULL;
+  if(fb == NULL) {
+    // Out of memory, draw the text directly and try caching it next time.
+    // A bitmap too small for the text would be drawn stale, let it go
+    freeCachedBitmap(cached);
+    drawShadowedText(ctx, cached);
+    cached->stale = true;
+    return;
+  }
+  uint8_t *cache = gbitmap_get_data(cached->bitmap);
+  uint16_t cacheRow = gbitmap_get_bytes_per_row(cached->bitmap);
+#if defined(PBL_BW)
+  // Only black and white can be underneath, so a bit per pixel saves them
+  GBitmapFormat format = gbitmap_get_format(fb);
+  for(int y = 0; y < area.size.h; y++) {
+    GBitmapDataRowInfo row = gbitmap_get_data_row_info(fb, area.origin.y + y);
+    for(int x = 0; x < area.size.w; x++) {
+      setCacheBit(cache + y * cacheRow, x, framebufferWhite(row.data, format, area.origin.x + x));
+    }
+  }
+  graphics_release_frame_buffer(ctx, fb);
+
+  graphics_context_set_fill_color(ctx, GColorBlack);
+  graphics_fill_rect(ctx, area, 0, GCornerNone);
+  drawShadowedText(ctx, cached);
+
+  fb = graphics_capture_frame_buffer(ctx);
+  for(int y = 0; y < area.size.h; y++) {
+    GBitmapDataRowInfo row = gbitmap_get_data_row_info(fb, area.origin.y + y);
+    uint8_t *pixels = cache + y * cacheRow;
+    for(int x = 0; x < area.size.w; x++) {
+      bool under = cacheBit(pixels, x);
+      setCacheBit(pixels, x, framebufferWhite(row.data, format, area.origin.x + x));
+      setFramebufferPixel(row.data, format, area.origin.x + x, under);
+    }
+  }
+  graphics_release_frame_buffer(ctx, fb);
+#else
+  for(int y = 0; y < area.size.h; y++) {
+    GBitmapDataRowInfo row = gbitmap_get_data_row_info(fb, area.origin.y + y);
+    memcpy(cache + y * cacheRow, row.data + area.origin.x, area.size.w);
+  }
+  graphics_release_frame_buffer(ctx, fb);
+
+  graphics_context_set_fill_color(ctx, settings.bgColor);
+  graphics_fill_rect(ctx, area, 0, GCornerNone);
+  drawShadowedText(ctx, cached);
+
+  fb = graphics_capture_frame_buffer(ctx);
+  for(int y = 0; y < area.size.h; y++) {
+    GBitmapDataRowInfo row = gbitmap_get_data_row_info(fb, area.origin.y + y);
+    uint8_t *screen = row.data + area.origin.x;
+    uint8_t *pixel = cache + y * cacheRow;
+    for(int x = 0; x < area.size.w; x++) {
+      uint8_t under = pixel[x];
+      if(screen[x] == settings.bgColor.argb) {
+        pixel[x] = GColorClear.argb;
+        screen[x] = under;
       } else {
-        behavTimer = app_timer_register((rand() % 4000) + 4000, pickNextBehav, NULL);
+        pixel[x] = screen[x];
       }
     }
   }
-
-  // Start the animation
-  nextFrame();
+  graphics_release_frame_buffer(ctx, fb);
+#endif
 }
 
-static void nextFrame()
-{
-  uint32_t nextDelay;
-
-  // Advance to the next APNG frame, and get the delay for this frame
-  if(gbitmap_sequence_update_bitmap_next_frame(curBehav, borisBitmap, &nextDelay)) {
-    bitmap_layer_set_bitmap(borisLayer, borisBitmap);
-    layer_mark_dirty(bitmap_layer_get_layer(borisLayer));
-  }
-
-  // Move Boris if current animation is a walking animation
-  if(settings.state == WALKLEFT) {
-    settings.borisX = settings.borisX - 2;
-    layer_set_frame(bitmap_layer_get_layer(borisLayer), GRect(settings.borisX, settings.borisY,
-                                                              settings.borisSize, settings.borisSize));
-  } else if(settings.state == WALKRIGHT) {
-    settings.borisX = settings.borisX + 2;
-    layer_set_frame(bitmap_layer_get_layer(borisLayer), GRect(settings.borisX, settings.borisY,
-                                                              settings.borisSize, settings.borisSize));
-  } else if(settings.state == WALKDOWN) {
-    settings.borisY = settings.borisY + 1;
-    layer_set_frame(bitmap_layer_get_layer(borisLayer), GRect(settings.borisX, settings.borisY,
-                                                              settings.borisSize, settings.borisSize));
-  } else if(settings.state == WALKUP) {
-    settings.borisY = settings.borisY - 1;
-    layer_set_frame(bitmap_layer_get_layer(borisLayer), GRect(settings.borisX, settings.borisY,
-                                                              settings.borisSize, settings.borisSize));
-  }
-  
-  // Pebble Time resolution is 144 x 168
-  // Make sure Boris doesn't get too far out of bounds
-  // Values are minutely adjusted for the empty space around the Boris sprites
-  int minX = - settings.borisSize + 5;
-  int minY = - settings.borisSize;
-  int maxX = 144 - 5;
-  int maxY = 168 - 3;
-  if(settings.borisX < minX || settings.borisX > maxX ||
-     settings.borisY < minY || settings.borisY > maxY) {
-    if(settings.borisX < minX) {
-      settings.borisX = maxX;
+static void textUpdateProc(Layer *layer, GContext *ctx) {
+  PERF_START(drawStart);
+  GRect bounds = layer_get_bounds(layer);
+  graphics_context_set_compositing_mode(ctx, GCompOpSet);
+  for(int i = 0; i < TEXT_COUNT; i++) {
+    if(texts[i].font == NULL) {
+      // Its font is still to be loaded, see startupSlices
+      continue;
     }
-    if(settings.borisX > maxX) {
-      settings.borisX = minX;
+    if(texts[i].stale) {
+      renderCachedText(ctx, &texts[i], bounds);
+    } else if(texts[i].bitmap != NULL) {
+      graphics_draw_bitmap_in_rect(ctx, texts[i].bitmap, texts[i].area);
     }
-    if(settings.borisY < minY) {
-      settings.borisY = maxY;
+  }
+  PERF_DRAW(drawStart);
+}
+
+static void invalidateCachedTexts() {
+  for(int i = 0; i < TEXT_COUNT; i++) {
+    texts[i].stale = true;
+  }
+  layer_mark_dirty(textLayer);
+}
+
+static void unloadCachedTexts() {
+  for(int i = 0; i < TEXT_COUNT; i++) {
+    freeCachedBitmap(&texts[i]);
+    texts[i].text[0] = '\0';
+  }
+}
+
+// Things that happen at a fixed time of day, sorted by minute of day so the
+// minute tick only has to look at the next one
+#define EVENT_BEDTIME 0
+#define EVENT_GETUP 1
+#define EVENT_WEATHER 2
+#define EVENT_PERF_REPORT 3
+
+#define WEATHER_INTERVAL 30
+// Most minutes runEvents() catches up on one by one
+#define CATCH_UP_MINUTES 15
+#if PERF_ENABLED
+#define MAX_EVENTS (MINUTES_PER_DAY / WEATHER_INTERVAL + MINUTES_PER_DAY / PERF_REPORT_MINUTES + 8)
+#else
+#define MAX_EVENTS (MINUTES_PER_DAY / WEATHER_INTERVAL + 8)
+#endif
+
+typedef struct TimedEvent {
+  uint16_t minute;
+  uint8_t type;
+} TimedEvent;
+
+static TimedEvent events[MAX_EVENTS];
+static int eventCount;
+// First event after lastMinute
+static int nextEvent;
+static int lastMinute = -1;
+
+static void addEvent(uint16_t minute, uint8_t type) {
+  if(minute == NO_TIME || eventCount == MAX_EVENTS) {
+    return;
+  }
+  // Insert sorted, events in the same minute keep the order they were added
+  int i = eventCount++;
+  while(i > 0 && events[i - 1].minute > minute) {
+    events[i] = events[i - 1];
+    i--;
+  }
+  events[i] = (TimedEvent) { minute, type };
+}
+
+// Point nextEvent at the first event after lastMinute
+static void seekEvents() {
+  nextEvent = 0;
+  while(nextEvent < eventCount && events[nextEvent].minute <= lastMinute) {
+    nextEvent++;
+  }
+  if(nextEvent == eventCount) {
+    nextEvent = 0;
+  }
+}
+
+static void buildEvents() {
+  eventCount = 0;
+  for(int minute = 0; minute < MINUTES_PER_DAY; minute += WEATHER_INTERVAL) {
+    addEvent(minute, EVENT_WEATHER);
+  }
+#if PERF_ENABLED
+  for(int minute = 0; minute < MINUTES_PER_DAY; minute += PERF_REPORT_MINUTES) {
+    addEvent(minute, EVENT_PERF_REPORT);
+  }
+#endif
+  addEvent(settings.bedtime, EVENT_BEDTIME);
+  addEvent(settings.getUpTime, EVENT_GETUP);
+  seekEvents();
+}
+
+static void requestWeather() {
+  // Begin dictionary
+  DictionaryIterator *iter;
+  if(app_message_outbox_begin(&iter) != APP_MSG_OK) {
+    return;
+  }
+
+  // Ask for the weather
+  const uint8_t packet[] = { PACKET_VERSION, PACKET_WEATHER_REQUEST };
+  dict_write_data(iter, MESSAGE_KEY_PACKET, packet, sizeof(packet));
+
+  // Send the message!
+  app_message_outbox_send();
+}
+
+// Move on to this hour's forecast, and ask for a new one when it runs low.
+// The phone answers with a forecast, or with nothing if it can't get one
+static void updateWeather() {
+  time_t now = time(NULL);
+  int8_t temperature;
+  uint8_t icon;
+  if(forecastAt(now, &temperature, &icon)) {
+    setWeather(temperature, icon);
+  }
+  if(forecastRunningOut(now)) {
+    requestWeather();
+  }
+}
+
+#if PERF_ENABLED
+static void sendPerfReport() {
+  DictionaryIterator *iter;
+  if(app_message_outbox_begin(&iter) != APP_MSG_OK) {
+    return;
+  }
+  uint8_t packet[2 + PERF_SUMMARY_SIZE] = { PACKET_VERSION, PACKET_PERF };
+  size_t size = 2 + perfWriteSummary(packet + 2, PERF_SUMMARY_SIZE);
+  dict_write_data(iter, MESSAGE_KEY_PACKET, packet, size);
+  app_message_outbox_send();
+}
+#endif
+
+static void fireEvent(uint8_t type) {
+  switch(type) {
+    case EVENT_BEDTIME:
+      changeAll(GOTOSLEEP, RANDOM); // Send the Borises to sleep
+    break;
+    case EVENT_GETUP:
+      changeAll(GETUP, RANDOM); // Wake them up
+    break;
+    case EVENT_WEATHER:
+      updateWeather();
+    break;
+#if PERF_ENABLED
+    case EVENT_PERF_REPORT:
+      sendPerfReport();
+    break;
+#endif
+  }
+}
+
+// The bedtime or get-up that happened last as of minute, or EVENT_WEATHER if
+// neither is set
+static uint8_t lastDailyEvent(int minute) {
+  uint8_t last = EVENT_WEATHER;
+  int lastAgo = MINUTES_PER_DAY;
+  for(int i = 0; i < eventCount; i++) {
+    if(events[i].type != EVENT_BEDTIME && events[i].type != EVENT_GETUP) {
+      continue;
     }
-    if(settings.borisY > maxY) {
-      settings.borisY = minY;
+    int ago = (minute - events[i].minute + MINUTES_PER_DAY) % MINUTES_PER_DAY;
+    if(ago < lastAgo) {
+      last = events[i].type;
+      lastAgo = ago;
     }
   }
+  return last;
+}
 
-  // If battery saver is on, double delay to update screen less often
-  if(settings.batterySaver == true) {
-    nextDelay *= 2;
+// The clock was changed, or ticks were missed for a long time. Rather than
+// catch up on every event in between, put the Borises in the state the time
+// of day calls for and ask for the weather once. Their deadlines count from
+// the old time, which may now be hours away, so they start again from now
+static void reseekEvents(int minute) {
+  lastMinute = minute;
+  seekEvents();
+  if(paused) {
+    pausedAt = nowMs();
+  }
+  for(int i = 0; i < borisCount; i++) {
+    borises[i].movedAt = schedNow();
   }
-  
-  // Timer for that frame's delay
-  if(oneShot == true && gbitmap_sequence_get_current_frame_idx(curBehav) >=
-     (int32_t)gbitmap_sequence_get_total_num_frames(curBehav)) {
-      frameTimer = app_timer_register(nextDelay, pickNextBehav, NULL);
+  uint8_t last = lastDailyEvent(minute);
+  if(last == EVENT_BEDTIME) {
+    if(!allAsleep()) {
+      changeAll(SLEEPING, INFINITE);
+    }
+  } else if(allAsleep()) {
+    if(last == EVENT_GETUP) {
+      changeAll(GETUP, RANDOM);
+    }
   } else {
-    frameTimer = app_timer_register(nextDelay, nextFrame, NULL);
+    changeAll(RANDOM, RANDOM);
   }
+  updateWeather();
 }
 
-static void loadWeatherIcons() {
-  wIcon01d = gbitmap_create_with_resource(RESOURCE_ID_01D);
-  wIcon01n = gbitmap_create_with_resource(RESOURCE_ID_01N);
-  wIcon02d = gbitmap_create_with_resource(RESOURCE_ID_02D);
-  wIcon02n = gbitmap_create_with_resource(RESOURCE_ID_02N);
-  wIcon03d = gbitmap_create_with_resource(RESOURCE_ID_03D);
-  wIcon03n = gbitmap_create_with_resource(RESOURCE_ID_03N);
-  wIcon04d = gbitmap_create_with_resource(RESOURCE_ID_04D);
-  wIcon04n = gbitmap_create_with_resource(RESOURCE_ID_04N);
-  wIcon09d = gbitmap_create_with_resource(RESOURCE_ID_09D);
-  wIcon09n = gbitmap_create_with_resource(RESOURCE_ID_09N);
-  wIcon10d = gbitmap_create_with_resource(RESOURCE_ID_10D);
-  wIcon10n = gbitmap_create_with_resource(RESOURCE_ID_10N);
-  wIcon11d = gbitmap_create_with_resource(RESOURCE_ID_11D);
-  wIcon11n = gbitmap_create_with_resource(RESOURCE_ID_11N);
-  wIcon13d = gbitmap_create_with_resource(RESOURCE_ID_13D);
-  wIcon13n = gbitmap_create_with_resource(RESOURCE_ID_13N);
-  wIcon50d = gbitmap_create_with_resource(RESOURCE_ID_50D);
-  wIcon50n = gbitmap_create_with_resource(RESOURCE_ID_50N);
+// Fire every event from the minute after lastMinute up to and including
+// minute. Normally that's a single minute, but ticks can be skipped. A gap
+// longer than CATCH_UP_MINUTES, or the clock going back, is a reseek
+static void runEvents(int minute) {
+  if(lastMinute < 0) {
+    lastMinute = minute;
+    seekEvents();
+    return;
+  }
+  if((minute - lastMinute + MINUTES_PER_DAY) % MINUTES_PER_DAY > CATCH_UP_MINUTES) {
+    reseekEvents(minute);
+    return;
+  }
+  while(lastMinute != minute) {
+    lastMinute = (lastMinute + 1) % MINUTES_PER_DAY;
+    while(eventCount > 0 && events[nextEvent].minute == lastMinute) {
+      uint8_t type = events[nextEvent].type;
+      nextEvent = (nextEvent + 1) % eventCount;
+      fireEvent(type);
+      if(eventCount == 1) {
+        break;
+      }
+    }
+  }
+}
+
+// Find the most recent bedtime or get-up that happened while the watchface
+// wasn't running. Returns EVENT_WEATHER if none was missed, the weather is
+// requested by the phone as soon as it connects anyway
+static uint8_t missedEvent(time_t now) {
+  if(settings.lastSeen == 0 || settings.lastSeen >= now) {
+    return EVENT_WEATHER;
+  }
+  struct tm *nowTime = localtime(&now);
+  int nowMinute = nowTime->tm_hour * 60 + nowTime->tm_min;
+  time_t minuteStart = now - nowTime->tm_sec;
+  uint8_t missed = EVENT_WEATHER;
+  time_t missedAt = settings.lastSeen;
+  for(int i = 0; i < eventCount; i++) {
+    if(events[i].type == EVENT_WEATHER) {
+      continue;
+    }
+    // Last time this event happened, up to and including this minute
+    int ago = (nowMinute - events[i].minute + MINUTES_PER_DAY) % MINUTES_PER_DAY;
+    time_t happened = minuteStart - ago * 60;
+    if(happened > missedAt) {
+      missed = events[i].type;
+      missedAt = happened;
+    }
+  }
+  return missed;
 }
 
 static void updateTime() {
@@ -369,239 +2026,226 @@ static void updateTime() {
   struct tm *tickTime = localtime(&temp);
 
   // Write the current hours and minutes into a buffer
-  static char timeBuffer[8];
-  static char dateBuffer[16];
+  char timeBuffer[8];
+  char dateBuffer[16];
   strftime(timeBuffer, sizeof(timeBuffer), "%H:%M", tickTime);
   strftime(dateBuffer, sizeof(dateBuffer), "%d %B", tickTime);
-  // Display this time on the TextLayer
-  text_layer_set_text(timeLayer, timeBuffer);
-  text_layer_set_text(dateLayer, dateBuffer);
-  text_layer_set_text(timeShadowLayer, timeBuffer);
-  text_layer_set_text(dateShadowLayer, dateBuffer);
-
-  // Is it time for Boris to go to sleep?
-  if(!strcmp(timeBuffer, settings.borisBedtime)) {
-    changeBehaviour(GOTOSLEEP, RANDOM); // Send Boris to sleep for 12 hours
-  }
-  // Is it time for Boris to go get up?
-  if(!strcmp(timeBuffer, settings.borisGetUpTime)) {
-    changeBehaviour(GETUP, RANDOM); // Wake Boris up
-  }
-
+  // Display this time, the text is only re-rendered if it changed
+  setCachedText(TEXT_TIME, timeBuffer);
+  setCachedText(TEXT_DATE, dateBuffer);
 }
 
 static void batteryUpdateProc(Layer *layer, GContext *ctx) {
+  PERF_START(drawStart);
   GRect bounds = layer_get_bounds(layer);
 
   // Calculate the relevant width of the bar
-  int width = (int)(((float)batteryLevel / 100.0F) * 144.0F);
+  int width = batteryLevel * bounds.size.w / 100;
   // Draw the bar
   graphics_context_set_fill_color(ctx, GColorWhite);
   graphics_fill_rect(ctx, GRect(0, 0, width, bounds.size.h), 0, GCornerNone);
+  PERF_DRAW(drawStart);
+}
+
+// The Borises are copied straight into the framebuffer, skipping the
+// compositor. The layer is a child of the window's root, so their positions
+// are in screen coordinates. The black and white framebuffer is 1-bit, there
+// the SDK draws them
+static void borisUpdateProc(Layer *layer, GContext *ctx) {
+  PERF_START(drawStart);
+#if defined(PBL_BW)
+  GPoint origin = layer_get_frame(layer).origin;
+  graphics_context_set_compositing_mode(ctx, GCompOpSet);
+#else
+  GBitmap *fb = graphics_capture_frame_buffer(ctx);
+  if(fb == NULL) {
+    return;
+  }
+#endif
+  for(int i = 0; i < borisCount; i++) {
+    Player *player = borisPlayer(&borises[i]);
+    if(player == NULL || player->frame == NULL) {
+      continue;
+    }
+    PERF_FIRST_FRAME();
+#if defined(PBL_BW)
+    graphics_draw_bitmap_in_rect(ctx, player->frame, GRect(pixels(borises[i].x) - origin.x, pixels(borises[i].y) - origin.y,
+                                                           settings.borisSize, settings.borisSize));
+#else
+    blitSet(fb, player->frame, GPoint(pixels(borises[i].x), pixels(borises[i].y)), player->mirrored);
+#endif
+  }
+#if !defined(PBL_BW)
+  graphics_release_frame_buffer(ctx, fb);
+#endif
+  PERF_DRAW(drawStart);
 }
 
 static void tickHandler(struct tm *tickTime, TimeUnits unitsChanged) {
+  PERF_WAKEUP();
   updateTime();
-   // Get weather update every 30 minutes
-  if(tickTime->tm_min % 30 == 0) {
-    // Begin dictionary
-    DictionaryIterator *iter;
-    app_message_outbox_begin(&iter);
-
-    // Add a key-value pair
-    dict_write_uint8(iter, 0, 0);
-
-    // Send the message!
-    app_message_outbox_send();
+  // Bedtime, get-up and weather updates
+  runEvents(tickTime->tm_hour * 60 + tickTime->tm_min);
+  // Let sleeping Borises breathe
+  for(int i = 0; i < PLAYER_SLOTS && !paused; i++) {
+    if(players[i].users > 0 && players[i].asleep) {
+      nextFrame(&players[i]);
+    }
   }
+  PERF_REFRESH();
 }
 
+// Runs the next of startupSlices, see init()
+static AppTimer *startupTimer;
+
+// Size of the screen the layout was made for
+#define LAYOUT_WIDTH 144
+#define LAYOUT_HEIGHT 168
+
 static void mainWindowLoad(Window *window) {
   // Get information about the Window
   Layer *windowLayer = window_get_root_layer(window);
   GRect bounds = layer_get_bounds(windowLayer);
+  screenSize = bounds.size;
+  // The layout is made for 144 x 168 and centred on other screens. Round
+  // screens need a bit more room on the left
+  GPoint origin = GPoint((bounds.size.w - LAYOUT_WIDTH) / 2 + PBL_IF_ROUND_ELSE(8, 0),
+                         (bounds.size.h - LAYOUT_HEIGHT) / 2);
 
-  // Load all behaviours
-  loadBehavs();
-
-  // load all weather icons
-  loadWeatherIcons();
-  
-  // Create blank GBitmap using APNG frame size
-  borisBitmap = gbitmap_create_blank(GSize(settings.borisSize, settings.borisSize), GBitmapFormat8Bit);
-
-  // Create BitmapLayer to display the GBitmap
-  borisLayer = bitmap_layer_create(GRect(settings.borisX, settings.borisY, settings.borisSize, settings.borisSize));
+  // Create the layer the Borises are drawn in, it follows them around
+  borisLayer = layer_create(GRect(settings.borisX, settings.borisY, settings.borisSize, settings.borisSize));
+  layer_set_update_proc(borisLayer, borisUpdateProc);
+  layer_add_child(windowLayer, borisLayer);
 
-  // Set the bitmap onto the layer and add to the window
-  bitmap_layer_set_compositing_mode(borisLayer, GCompOpSet);
-  bitmap_layer_set_bitmap(borisLayer, borisBitmap);
-  layer_add_child(windowLayer, bitmap_layer_get_layer(borisLayer));
+  // Create BitmapLayer to display the weather icon
+  weatherIconLayer = bitmap_layer_create(GRect(origin.x + 13, origin.y + 98, WEATHER_ICON_SIZE, WEATHER_ICON_SIZE));
 
-  // Create blank GBitmap using APNG frame size
-  weatherBitmap = gbitmap_create_with_resource(RESOURCE_ID_50D);
-
-  // Create BitmapLayer to display the GBitmap
-  weatherIconLayer = bitmap_layer_create(GRect(13, 98, 32, 32));
-
-  // Set the bitmap onto the layer and add to the window
+  // Add it to the window, the icons are loaded after the first frame
   bitmap_layer_set_compositing_mode(weatherIconLayer, GCompOpSet);
-  bitmap_layer_set_bitmap(weatherIconLayer, weatherBitmap);
   layer_add_child(windowLayer, bitmap_layer_get_layer(weatherIconLayer));
 
-  // Create GFont
+  // Create GFont. Only the clock's is needed for the first frame
   timeFont = fonts_load_custom_font(resource_get_handle(RESOURCE_ID_FONT_48));
-  weatherFont = fonts_load_custom_font(resource_get_handle(RESOURCE_ID_FONT_20));
 
-  timeLayer = text_layer_create(GRect(13, 10, bounds.size.w, 50));
-  dateLayer = text_layer_create(GRect(13, 60, bounds.size.w, 50));
-  timeShadowLayer = text_layer_create(GRect(13, 14, bounds.size.w, 50));
-  dateShadowLayer = text_layer_create(GRect(13, 64, bounds.size.w, 50));
-
-  // Improve the layout to be more like a watchface
-  text_layer_set_background_color(timeLayer, GColorClear);
-  text_layer_set_text_color(timeLayer, GColorWhite);
-  text_layer_set_font(timeLayer, timeFont);
-  text_layer_set_text_alignment(timeLayer, GTextAlignmentLeft);
-
-  text_layer_set_background_color(dateLayer, GColorClear);
-  text_layer_set_text_color(dateLayer, GColorWhite);
-  text_layer_set_font(dateLayer, weatherFont);
-  text_layer_set_text_alignment(dateLayer, GTextAlignmentLeft);
-
-  // Repeat for shadow layers
-  text_layer_set_background_color(timeShadowLayer, GColorClear);
-  text_layer_set_text_color(timeShadowLayer, GColorBlack);
-  text_layer_set_font(timeShadowLayer, timeFont);
-  text_layer_set_text_alignment(timeShadowLayer, GTextAlignmentLeft);
-
-  text_layer_set_background_color(dateShadowLayer, GColorClear);
-  text_layer_set_text_color(dateShadowLayer, GColorBlack);
-  text_layer_set_font(dateShadowLayer, weatherFont);
-  text_layer_set_text_alignment(dateShadowLayer, GTextAlignmentLeft);
-  
-  // Create temperature Layer
-  weatherTextLayer = text_layer_create(GRect(13, 115, bounds.size.w, 25));
-  weatherTextShadowLayer = text_layer_create(GRect(13, 119, bounds.size.w, 25));
-
-  // Style the text
-  text_layer_set_background_color(weatherTextLayer, GColorClear);
-  text_layer_set_text_color(weatherTextLayer, GColorWhite);
-  text_layer_set_text_alignment(weatherTextLayer, GTextAlignmentLeft);
-  text_layer_set_text(weatherTextLayer, "Loading...");
-
-  // Style the shadow
-  text_layer_set_background_color(weatherTextShadowLayer, GColorClear);
-  text_layer_set_text_color(weatherTextShadowLayer, GColorBlack);
-  text_layer_set_text_alignment(weatherTextShadowLayer, GTextAlignmentLeft);
-  text_layer_set_text(weatherTextShadowLayer, "Loading...");
-
-  // Create second custom font, apply it and add to Window
-  text_layer_set_font(weatherTextLayer, weatherFont);
-  text_layer_set_font(weatherTextShadowLayer, weatherFont);
-  
-  // Create battery meter Layer
-  batteryLayer = layer_create(GRect(0, 150, 144, 2));
+  // Create the layer holding the time, date and temperature
+  texts[TEXT_TIME].frame = GRect(origin.x + 13, origin.y + 10, bounds.size.w - origin.x - 13, 50);
+  texts[TEXT_TIME].font = timeFont;
+  texts[TEXT_DATE].frame = GRect(origin.x + 13, origin.y + 60, bounds.size.w - origin.x - 13, 50);
+  texts[TEXT_DATE].font = NULL;
+  texts[TEXT_WEATHER].frame = GRect(origin.x + 13, origin.y + 115, bounds.size.w - origin.x - 13, 25);
+  texts[TEXT_WEATHER].font = NULL;
+  textLayer = layer_create(bounds);
+  layer_set_update_proc(textLayer, textUpdateProc);
+  showWeatherText();
+
+  // Create battery meter Layer, full width on rectangular screens
+  batteryLayer = layer_create(PBL_IF_ROUND_ELSE(GRect(origin.x + 13, origin.y + 150, LAYOUT_WIDTH - 26, 2),
+                                                GRect(0, origin.y + 150, bounds.size.w, 2)));
   layer_set_update_proc(batteryLayer, batteryUpdateProc);
 
-  // Add shadow layers
-  layer_add_child(windowLayer, text_layer_get_layer(timeShadowLayer));
-  layer_add_child(windowLayer, text_layer_get_layer(dateShadowLayer));
-  layer_add_child(windowLayer, text_layer_get_layer(weatherTextShadowLayer));
-  
-  // Add front font layers
-  layer_add_child(windowLayer, text_layer_get_layer(timeLayer));
-  layer_add_child(windowLayer, text_layer_get_layer(dateLayer));
-  layer_add_child(windowLayer, text_layer_get_layer(weatherTextLayer));
+  // Add text layer
+  layer_add_child(windowLayer, textLayer);
 
   // Add to Window
   layer_add_child(window_get_root_layer(window), batteryLayer);
+#if PERF_OVERLAY
+  // Counters go right under the battery bar
+  layer_add_child(windowLayer, perfCreateOverlay(GRect(0, origin.y + 152, bounds.size.w, 16)));
+#endif
 }
 
 static void mainWindowUnload(Window *window) {
-  text_layer_destroy(timeLayer);
-  text_layer_destroy(timeShadowLayer);
-  text_layer_destroy(dateLayer);
-  text_layer_destroy(dateShadowLayer);
-  text_layer_destroy(weatherTextLayer);
-  text_layer_destroy(weatherTextShadowLayer);
-  gbitmap_destroy(borisBitmap);
-  bitmap_layer_destroy(borisLayer);
-  gbitmap_destroy(weatherBitmap);
+  if(startupTimer != NULL) {
+    app_timer_cancel(startupTimer);
+    startupTimer = NULL;
+  }
+  stopPresence();
+  schedCancel();
+  unloadPlayers();
+  unloadFrameRings();
+  unloadBehavs();
+  layer_destroy(textLayer);
+  unloadCachedTexts();
+  layer_destroy(borisLayer);
   bitmap_layer_destroy(weatherIconLayer);
-  fonts_unload_custom_font(weatherFont);
+  gbitmap_destroy(weatherBitmap);
+  weatherBitmap = NULL;
+  if(weatherIcons != NULL) {
+    gbitmap_destroy(weatherIcons);
+    weatherIcons = NULL;
+  }
+  if(weatherFont != NULL) {
+    fonts_unload_custom_font(weatherFont);
+    weatherFont = NULL;
+  }
   fonts_unload_custom_font(timeFont);
   layer_destroy(batteryLayer);
+#if PERF_OVERLAY
+  perfDestroyOverlay();
+#endif
+}
+
+// Read a little endian minute of day, anything out of range turns it off
+static uint16_t readMinuteOfDay(const uint8_t *data) {
+  uint16_t minute = data[0] | (data[1] << 8);
+  return minute < MINUTES_PER_DAY ? minute : NO_TIME;
 }
 
 static void inboxReceivedCallback(DictionaryIterator *iterator, void *context) {
-  // Read tuples for data
-  Tuple *tempTuple = dict_find(iterator, MESSAGE_KEY_TEMPERATURE);
-  Tuple *iconTuple = dict_find(iterator, MESSAGE_KEY_ICON);
-  Tuple *bgColorTuple = dict_find(iterator, MESSAGE_KEY_BackgroundColor);
-  Tuple *bedtimeTuple = dict_find(iterator, MESSAGE_KEY_Bedtime);
-  Tuple *getUpTimeTuple = dict_find(iterator, MESSAGE_KEY_GetUpTime);
-  Tuple *batterySaverTuple = dict_find(iterator, MESSAGE_KEY_BatterySaver);
-
-  // If all data is available, use it
-  if(tempTuple && iconTuple) {
-    static char iconBuffer[4];
-    static char temperatureBuffer[4];
-    snprintf(temperatureBuffer, sizeof(temperatureBuffer), "%dC", (int)tempTuple->value->int32);
-    snprintf(iconBuffer, sizeof(iconBuffer), "%s", iconTuple->value->cstring);
-    text_layer_set_text(weatherTextLayer, temperatureBuffer);
-    text_layer_set_text(weatherTextShadowLayer, temperatureBuffer);
-    //APP_LOG(APP_LOG_LEVEL_INFO, "Temperature is: %s", blahBuffer);
-    if(!strncmp(iconBuffer, "01d", 3)) {
-      bitmap_layer_set_bitmap(weatherIconLayer, wIcon01d);
-    } else if(!strncmp(iconBuffer, "01n", 3)) {
-      bitmap_layer_set_bitmap(weatherIconLayer, wIcon01n);
-    } else if(!strncmp(iconBuffer, "02d", 3)) {
-      bitmap_layer_set_bitmap(weatherIconLayer, wIcon02d);
-    } else if(!strncmp(iconBuffer, "02n", 3)) {
-      bitmap_layer_set_bitmap(weatherIconLayer, wIcon02n);
-    } else if(!strncmp(iconBuffer, "03d", 3)) {
-      bitmap_layer_set_bitmap(weatherIconLayer, wIcon03d);
-    } else if(!strncmp(iconBuffer, "03n", 3)) {
-      bitmap_layer_set_bitmap(weatherIconLayer, wIcon03n);
-    } else if(!strncmp(iconBuffer, "04d", 3)) {
-      bitmap_layer_set_bitmap(weatherIconLayer, wIcon04d);
-    } else if(!strncmp(iconBuffer, "04n", 3)) {
-      bitmap_layer_set_bitmap(weatherIconLayer, wIcon04n);
-    } else if(!strncmp(iconBuffer, "09d", 3)) {
-      bitmap_layer_set_bitmap(weatherIconLayer, wIcon09d);
-    } else if(!strncmp(iconBuffer, "09n", 3)) {
-      bitmap_layer_set_bitmap(weatherIconLayer, wIcon09n);
-    } else if(!strncmp(iconBuffer, "10d", 3)) {
-      bitmap_layer_set_bitmap(weatherIconLayer, wIcon10d);
-    } else if(!strncmp(iconBuffer, "10n", 3)) {
-      bitmap_layer_set_bitmap(weatherIconLayer, wIcon10n);
-    } else if(!strncmp(iconBuffer, "11d", 3)) {
-      bitmap_layer_set_bitmap(weatherIconLayer, wIcon11d);
-    } else if(!strncmp(iconBuffer, "11n", 3)) {
-      bitmap_layer_set_bitmap(weatherIconLayer, wIcon11n);
-    } else if(!strncmp(iconBuffer, "13d", 3)) {
-      bitmap_layer_set_bitmap(weatherIconLayer, wIcon13d);
-    } else if(!strncmp(iconBuffer, "13n", 3)) {
-      bitmap_layer_set_bitmap(weatherIconLayer, wIcon13n);
-    } else if(!strncmp(iconBuffer, "50d", 3)) {
-      bitmap_layer_set_bitmap(weatherIconLayer, wIcon50d);
-    } else if(!strncmp(iconBuffer, "50n", 3)) {
-      bitmap_layer_set_bitmap(weatherIconLayer, wIcon50n);
-    }
-    layer_mark_dirty(bitmap_layer_get_layer(weatherIconLayer));
-  }
-  if(bgColorTuple) {
-    settings.bgColor = GColorFromHEX(bgColorTuple->value->int32);
-    window_set_background_color(mainWindow, settings.bgColor);
-    saveSettings();
-  }
-  if(bedtimeTuple && getUpTimeTuple) {
-    settings.borisBedtime = bedtimeTuple->value->cstring;
-    settings.borisGetUpTime = getUpTimeTuple->value->cstring;
-  }
-  if(batterySaverTuple) {
-    settings.batterySaver = batterySaverTuple->value->int8;
+  Tuple *packetTuple = dict_find(iterator, MESSAGE_KEY_PACKET);
+  if(!packetTuple || packetTuple->length < 2 || packetTuple->value->data[0] != PACKET_VERSION) {
+    APP_LOG(APP_LOG_LEVEL_ERROR, "Unknown message");
+    return;
+  }
+  const uint8_t *data = packetTuple->value->data;
+  uint16_t length = packetTuple->length;
+
+  switch(data[1]) {
+    case PACKET_WEATHER:
+      if(length >= 4) {
+        setWeather((int8_t)data[2], data[3]);
+      }
+    break;
+    case PACKET_FORECAST:
+      if(length >= 8) {
+        forecast.start = data[2] | (data[3] << 8) | (data[4] << 16) | ((uint32_t)data[5] << 24);
+        forecast.count = (length - 6) / 2 < FORECAST_SLOTS ? (length - 6) / 2 : FORECAST_SLOTS;
+        for(int i = 0; i < forecast.count; i++) {
+          forecast.temperatures[i] = (int8_t)data[6 + 2 * i];
+          forecast.icons[i] = data[7 + 2 * i];
+        }
+        persist_write_data(FORECAST_KEY, &forecast, sizeof(forecast));
+        int8_t temperature;
+        uint8_t icon;
+        if(forecastAt(time(NULL), &temperature, &icon)) {
+          setWeather(temperature, icon);
+        }
+      }
+    break;
+    case PACKET_CONFIG:
+      if(length >= 8) {
+        GColor bgColor = (GColor){ .argb = data[3] };
+        if(!gcolor_equal(bgColor, settings.bgColor)) {
+          settings.bgColor = bgColor;
+          window_set_background_color(mainWindow, backgroundColor());
+          // Text is rendered against the background colour
+          invalidateCachedTexts();
+        }
+        settings.batterySaver = (data[2] & CONFIG_BATTERY_SAVER) != 0;
+        updateBatteryTier(battery_state_service_peek());
+        settings.wristPause = (data[2] & CONFIG_WRIST_PAUSE) != 0;
+        settings.caughtYou = (data[2] & CONFIG_CAUGHT_YOU) != 0;
+        updatePresence();
+        if(length >= 9) {
+          settings.borisCount = data[8];
+          updateBorisCount();
+        }
+        settings.bedtime = readMinuteOfDay(data + 4);
+        settings.getUpTime = readMinuteOfDay(data + 6);
+        buildEvents();
+        saveSettings();
+      }
+    break;
   }
 }
 
@@ -620,12 +2264,72 @@ static void outboxSentCallback(DictionaryIterator *iterator, void *context) {
 static void batteryCallback(BatteryChargeState state) {
   // Record the new battery level
   batteryLevel = state.charge_percent;
+  // Pick the frame rate cap for this battery tier
+  updateBatteryTier(state);
   // Update meter
   layer_mark_dirty(batteryLayer);
 }
 
+// Startup work the first frame doesn't need. Each slice runs from its own
+// timer after the previous one, so the firmware can draw in between
+#define STARTUP_SLICE_MS 20
+
+static void loadTextFont() {
+  weatherFont = fonts_load_custom_font(resource_get_handle(RESOURCE_ID_FONT_20));
+  texts[TEXT_DATE].font = weatherFont;
+  texts[TEXT_WEATHER].font = weatherFont;
+  invalidateCachedTexts();
+}
+
+static void loadWeatherIcons() {
+  weatherIcons = gbitmap_create_with_resource(RESOURCE_ID_WEATHER_ICONS);
+  setWeatherIcon(weatherIconIndex(weatherAt != 0 ? weatherIcon : 50));
+}
+
+static void openMessaging() {
+  // Register callbacks
+  app_message_register_inbox_received(inboxReceivedCallback);
+  app_message_register_inbox_dropped(inboxDroppedCallback);
+  app_message_register_outbox_failed(outboxFailedCallback);
+  app_message_register_outbox_sent(outboxSentCallback);
+  battery_state_service_subscribe(batteryCallback);
+
+  // Open AppMessage
+  const int inboxSize = dict_calc_buffer_size(1, PACKET_MAX_SIZE);
+#if PERF_ENABLED
+  const int outboxSize = dict_calc_buffer_size(1, 2 + PERF_SUMMARY_SIZE);
+#else
+  const int outboxSize = dict_calc_buffer_size(1, PACKET_MAX_SIZE);
+#endif
+  app_message_open(inboxSize, outboxSize);
+}
+
+static void (*const startupSlices[])(void) = {
+  loadTextFont,
+  loadWeatherIcons,
+  openMessaging,
+  updatePresence,
+  updateBorisCount,
+  seekPlayers
+};
+
+static void startupSlice(void *data) {
+  unsigned int slice = (unsigned int)(uintptr_t)data;
+  PERF_WAKEUP();
+  startupSlices[slice]();
+  if(slice + 1 < ARRAY_LENGTH(startupSlices)) {
+    startupTimer = app_timer_register(STARTUP_SLICE_MS, startupSlice, (void *)(uintptr_t)(slice + 1));
+  } else {
+    startupTimer = NULL;
+    PERF_STARTUP_DONE();
+  }
+}
+
 static void init() {
+  PERF_LAUNCH();
   loadSettings();
+  loadScene();
+  loadForecast();
   mainWindow = window_create();
   window_set_window_handlers(mainWindow, (WindowHandlers) {
     .load = mainWindowLoad,
@@ -635,33 +2339,54 @@ static void init() {
 
   // Make sure the time is displayed from the start
   updateTime();
-  
+
   // Register with TickTimerService
   tick_timer_service_subscribe(MINUTE_UNIT, tickHandler);
-  
-  window_set_background_color(mainWindow, settings.bgColor);
 
-  // Register callbacks
-  app_message_register_inbox_received(inboxReceivedCallback);
-  app_message_register_inbox_dropped(inboxDroppedCallback);
-  app_message_register_outbox_failed(outboxFailedCallback);
-  app_message_register_outbox_sent(outboxSentCallback);
-  battery_state_service_subscribe(batteryCallback);
+  window_set_background_color(mainWindow, backgroundColor());
 
-  // Open AppMessage
-  const int inboxSize = 128;
-  const int outboxSize = 128;
-  app_message_open(inboxSize, outboxSize);
-  
   // Ensure battery level is displayed from the start
   batteryCallback(battery_state_service_peek());
 
-  // Initialize Boris with a random behaviour
-  changeBehaviour(RANDOM, RANDOM);
+  // Start counting minutes from now and catch up on bedtime or get-up if
+  // either happened while we weren't running
+  time_t now = time(NULL);
+  struct tm *nowTime = localtime(&now);
+  lastMinute = nowTime->tm_hour * 60 + nowTime->tm_min;
+  buildEvents();
+  uint8_t missed = missedEvent(now);
+  // The first Boris is back where he was, the others join him once
+  // startup is done
+  borisCount = 1;
+  borises[0] = (Boris){ .x = toFixed(settings.borisX), .y = toFixed(settings.borisY), .behav = settings.state,
+                        .player = NO_PLAYER, .movedAt = schedNow() };
+  if(missed == EVENT_BEDTIME) {
+    changeAll(SLEEPING, INFINITE);
+  } else if(missed == EVENT_GETUP) {
+    changeAll(GETUP, RANDOM);
+  } else if(restoreScene()) {
+    // Carry on where we left off
+  } else if(settings.state == SLEEPING || settings.state == GOTOSLEEP) {
+    // Still asleep from last time
+    changeAll(SLEEPING, INFINITE);
+  } else {
+    // Initialize Boris with a random behaviour
+    changeAll(RANDOM, RANDOM);
+  }
+
+  // Everything else once the first frame is on screen
+  startupTimer = app_timer_register(STARTUP_SLICE_MS, startupSlice, (void *)0);
 }
 
 static void deinit() {
+  saveScene();
   window_destroy(mainWindow);
+  // Remember where the first Boris was, and when we stopped so missed
+  // events can be caught up on
+  settings.state = borises[0].behav;
+  settings.borisX = pixels(borises[0].x);
+  settings.borisY = pixels(borises[0].y);
+  settings.lastSeen = time(NULL);
   saveSettings();
 }
 
@@ -669,4 +2394,5 @@ int main(void) {
   init();
   app_event_loop();
   deinit();
+  return 0;
 }
\ No newline at end of file
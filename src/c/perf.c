@@ -0,0 +1,141 @@
+#include "perf.h"
+
+#if PERF_ENABLED
+
+typedef struct PerfCounters {
+  uint32_t frames;
+  uint32_t wakeups;
+  uint32_t decodeMs;
+  uint32_t drawMs;
+} PerfCounters;
+
+static PerfCounters counters[PERF_SLOTS];
+static uint8_t curSlot;
+static size_t heapPeak;
+// perfNow() when the last summary was written
+static uint32_t since;
+// perfNow() at launch, and whether the first frame was logged since
+static uint32_t launched;
+static bool firstFrameLogged;
+
+#if PERF_OVERLAY
+static Layer *overlayLayer;
+#endif
+
+uint32_t perfNow(void) {
+  time_t seconds;
+  uint16_t ms;
+  time_ms(&seconds, &ms);
+  return (uint32_t)seconds * 1000 + ms;
+}
+
+void perfSetSlot(uint8_t slot) {
+  curSlot = slot < PERF_SLOTS ? slot : 0;
+}
+
+void perfWakeup(void) {
+  counters[curSlot].wakeups++;
+  size_t used = heap_bytes_used();
+  if(used > heapPeak) {
+    heapPeak = used;
+  }
+}
+
+void perfFrame(void) {
+  counters[curSlot].frames++;
+}
+
+void perfAddDecode(uint32_t start) {
+  counters[curSlot].decodeMs += perfNow() - start;
+}
+
+void perfAddDraw(uint32_t start) {
+  counters[curSlot].drawMs += perfNow() - start;
+}
+
+void perfLaunch(void) {
+  launched = perfNow();
+  since = launched;
+  firstFrameLogged = false;
+}
+
+void perfFirstFrame(void) {
+  if(!firstFrameLogged) {
+    firstFrameLogged = true;
+    APP_LOG(APP_LOG_LEVEL_INFO, "First frame %lu ms after launch", (unsigned long)(perfNow() - launched));
+  }
+}
+
+void perfStartupDone(void) {
+  APP_LOG(APP_LOG_LEVEL_INFO, "Startup done %lu ms after launch", (unsigned long)(perfNow() - launched));
+}
+
+static uint8_t *write16(uint8_t *out, uint32_t value) {
+  if(value > 0xFFFF) {
+    value = 0xFFFF;
+  }
+  out[0] = value & 0xFF;
+  out[1] = value >> 8;
+  return out + 2;
+}
+
+// Layout, little endian: uint16 seconds covered, uint16 heap used, uint16
+// peak heap, then for each slot that did anything: uint8 slot, uint16
+// frames, wakeups, decode ms and draw ms
+size_t perfWriteSummary(uint8_t *buffer, size_t size) {
+  if(size < PERF_SUMMARY_SIZE) {
+    return 0;
+  }
+  uint32_t now = perfNow();
+  uint8_t *out = buffer;
+  out = write16(out, (now - since) / 1000);
+  out = write16(out, heap_bytes_used());
+  out = write16(out, heapPeak);
+  for(int i = 0; i < PERF_SLOTS; i++) {
+    PerfCounters *slot = &counters[i];
+    if(slot->frames == 0 && slot->wakeups == 0) {
+      continue;
+    }
+    *out++ = i;
+    out = write16(out, slot->frames);
+    out = write16(out, slot->wakeups);
+    out = write16(out, slot->decodeMs);
+    out = write16(out, slot->drawMs);
+  }
+  memset(counters, 0, sizeof(counters));
+  heapPeak = heap_bytes_used();
+  since = now;
+  return out - buffer;
+}
+
+#if PERF_OVERLAY
+static void overlayUpdateProc(Layer *layer, GContext *ctx) {
+  PerfCounters *slot = &counters[curSlot];
+  char text[64];
+  snprintf(text, sizeof(text), "#%d f%lu d%lu u%lu h%u/%uk", curSlot, (unsigned long)slot->frames,
+           (unsigned long)slot->decodeMs, (unsigned long)slot->drawMs,
+           (unsigned)(heap_bytes_used() / 1024), (unsigned)(heapPeak / 1024));
+  graphics_context_set_text_color(ctx, GColorWhite);
+  graphics_draw_text(ctx, text, fonts_get_system_font(FONT_KEY_GOTHIC_14), layer_get_bounds(layer),
+                     GTextOverflowModeTrailingEllipsis, GTextAlignmentLeft, NULL);
+}
+
+Layer *perfCreateOverlay(GRect frame) {
+  overlayLayer = layer_create(frame);
+  layer_set_update_proc(overlayLayer, overlayUpdateProc);
+  return overlayLayer;
+}
+
+void perfDestroyOverlay(void) {
+  layer_destroy(overlayLayer);
+  overlayLayer = NULL;
+}
+
+void perfRefreshOverlay(void) {
+  if(overlayLayer != NULL) {
+    layer_mark_dirty(overlayLayer);
+  }
+}
+#endif
+
+#endif
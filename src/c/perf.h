@@ -0,0 +1,77 @@
+#pragma once
+
+#include <pebble.h>
+#include "behaviours.h"
+
+// Counters for finding out which behaviours and code paths drain the battery.
+// Everything here compiles away unless PERF_ENABLED is 1, either here or with
+// -DPERF_ENABLED=1. PERF_OVERLAY also shows the counters under the battery
+// bar. The whole window is redrawn on every frame, so the overlay's text
+// rendering shows up in the draw times it reports
+#ifndef PERF_ENABLED
+#define PERF_ENABLED 0
+#endif
+#ifndef PERF_OVERLAY
+#define PERF_OVERLAY 0
+#endif
+
+// Counters are kept per behaviour slot, one for every behaviour in
+// resources/behaviours.json
+#define PERF_SLOTS BEHAV_COUNT
+// Minutes between summaries sent to the phone
+#define PERF_REPORT_MINUTES 15
+// Largest summary written by perfWriteSummary
+#define PERF_SUMMARY_SIZE (6 + PERF_SLOTS * 9)
+
+#if PERF_ENABLED
+
+void perfSetSlot(uint8_t slot);
+void perfWakeup(void);
+void perfFrame(void);
+uint32_t perfNow(void);
+void perfAddDecode(uint32_t start);
+void perfAddDraw(uint32_t start);
+// Startup timing, logged: launch, first Boris frame drawn and the last
+// deferred startup slice done
+void perfLaunch(void);
+void perfFirstFrame(void);
+void perfStartupDone(void);
+
+// Write the counters since the last summary into buffer and reset them.
+// Returns the number of bytes written
+size_t perfWriteSummary(uint8_t *buffer, size_t size);
+
+#if PERF_OVERLAY
+Layer *perfCreateOverlay(GRect frame);
+void perfDestroyOverlay(void);
+// Redraw the overlay with the latest numbers
+void perfRefreshOverlay(void);
+#define PERF_REFRESH() perfRefreshOverlay()
+#else
+#define PERF_REFRESH()
+#endif
+
+#define PERF_SLOT(slot) perfSetSlot(slot)
+#define PERF_WAKEUP() perfWakeup()
+#define PERF_FRAME() perfFrame()
+#define PERF_START(name) uint32_t name = perfNow()
+#define PERF_DECODE(name) perfAddDecode(name)
+#define PERF_DRAW(name) perfAddDraw(name)
+#define PERF_LAUNCH() perfLaunch()
+#define PERF_FIRST_FRAME() perfFirstFrame()
+#define PERF_STARTUP_DONE() perfStartupDone()
+
+#else
+
+#define PERF_SLOT(slot)
+#define PERF_WAKEUP()
+#define PERF_FRAME()
+#define PERF_START(name)
+#define PERF_DECODE(name)
+#define PERF_DRAW(name)
+#define PERF_REFRESH()
+#define PERF_LAUNCH()
+#define PERF_FIRST_FRAME()
+#define PERF_STARTUP_DONE()
+
+#endif
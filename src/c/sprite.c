@@ -0,0 +1,246 @@
+#include "sprite.h"
+#include "budget.h"
+
+// See tools/spritec.py for the layout
+#define SPRITE_VERSION 1
+#define SPRITE_HEADER_SIZE 8
+#define SPRITE_INDEX_ENTRY_SIZE 8
+#define SPRITE_RECT_SIZE 4
+
+// Frame data is streamed through this buffer. Frames are decoded one at a
+// time, so all sprites share it
+static uint8_t readBuffer[SPRITE_BUFFER_SIZE];
+
+struct Sprite {
+  // False while the pool slot is free
+  bool open;
+  ResHandle handle;
+  uint8_t bpp;
+  uint8_t width;
+  uint8_t height;
+  uint8_t frameCount;
+  uint8_t paletteSize;
+  // Next frame to draw, and frames drawn in this loop
+  uint8_t next;
+  uint8_t shown;
+  GColor palette[SPRITE_MAX_COLORS];
+};
+
+// Sprites are opened and closed as behaviours come and go, so they are kept
+// in a fixed pool rather than on the heap
+static Sprite spritePool[SPRITE_SLOTS];
+
+typedef struct Reader {
+  ResHandle handle;
+  uint32_t pos;
+  uint32_t end;
+  uint8_t length;
+  uint8_t at;
+} Reader;
+
+static uint16_t read16(const uint8_t *data) {
+  return data[0] | (data[1] << 8);
+}
+
+static uint32_t read32(const uint8_t *data) {
+  return data[0] | (data[1] << 8) | (data[2] << 16) | ((uint32_t)data[3] << 24);
+}
+
+// Returns false when the frame data runs out
+static bool readByte(Reader *reader, uint8_t *value) {
+  if(reader->at == reader->length) {
+    uint32_t left = reader->end - reader->pos;
+    reader->length = left < SPRITE_BUFFER_SIZE ? left : SPRITE_BUFFER_SIZE;
+    reader->at = 0;
+    if(reader->length == 0 ||
+       resource_load_byte_range(reader->handle, reader->pos, readBuffer, reader->length) != reader->length) {
+      reader->length = 0;
+      return false;
+    }
+    reader->pos += reader->length;
+  }
+  *value = readBuffer[reader->at++];
+  return true;
+}
+
+Sprite *spriteCreate(uint32_t resourceId) {
+  ResHandle handle = resource_get_handle(resourceId);
+  uint8_t header[SPRITE_HEADER_SIZE];
+  if(resource_load_byte_range(handle, 0, header, sizeof(header)) != sizeof(header) ||
+     header[0] != 'B' || header[1] != 'S' || header[2] != SPRITE_VERSION ||
+     (header[3] != 1 && header[3] != 2 && header[3] != 4 && header[3] != 8)) {
+    APP_LOG(APP_LOG_LEVEL_ERROR, "Resource %d is not a sprite", (int)resourceId);
+    return NULL;
+  }
+  uint8_t paletteSize = header[7];
+  // Palettized canvases use the palette directly, so it needs an entry for
+  // every index even if the sprite has fewer colours
+  uint16_t slots = header[3] < 8 ? 1 << header[3] : paletteSize;
+  if(paletteSize > slots || slots > SPRITE_MAX_COLORS) {
+    APP_LOG(APP_LOG_LEVEL_ERROR, "Resource %d has too many colours", (int)resourceId);
+    return NULL;
+  }
+  Sprite *sprite = NULL;
+  for(int i = 0; sprite == NULL && i < SPRITE_SLOTS; i++) {
+    if(!spritePool[i].open) {
+      sprite = &spritePool[i];
+    }
+  }
+  if(sprite == NULL) {
+    APP_LOG(APP_LOG_LEVEL_ERROR, "No free sprite for resource %d", (int)resourceId);
+    return NULL;
+  }
+  sprite->open = true;
+  sprite->handle = handle;
+  sprite->bpp = header[3];
+  sprite->width = header[4];
+  sprite->height = header[5];
+  sprite->frameCount = header[6];
+  sprite->paletteSize = paletteSize;
+  memset(sprite->palette, GColorClear.argb, slots * sizeof(GColor));
+  resource_load_byte_range(handle, SPRITE_HEADER_SIZE, (uint8_t *)sprite->palette, paletteSize);
+  spriteRestart(sprite);
+  return sprite;
+}
+
+void spriteDestroy(Sprite *sprite) {
+  if(sprite != NULL) {
+    sprite->open = false;
+  }
+}
+
+static GBitmapFormat canvasFormat(const Sprite *sprite) {
+  switch(sprite->bpp) {
+    case 1:
+      return GBitmapFormat1BitPalette;
+    case 2:
+      return GBitmapFormat2BitPalette;
+    case 4:
+      return GBitmapFormat4BitPalette;
+    default:
+      return GBitmapFormat8Bit;
+  }
+}
+
+GBitmap *spriteCanvas(const Sprite *sprite, GBitmap *canvas) {
+  GBitmapFormat format = canvasFormat(sprite);
+  if(canvas != NULL) {
+    GSize size = gbitmap_get_bounds(canvas).size;
+    if(gbitmap_get_format(canvas) != format || size.w != sprite->width || size.h != sprite->height) {
+      gbitmap_destroy(canvas);
+      canvas = NULL;
+    }
+  }
+  if(format == GBitmapFormat8Bit) {
+    return canvas != NULL ? canvas : gbitmap_create_blank(GSize(sprite->width, sprite->height), format);
+  }
+  // The palette stays with the sprite, it must outlive the canvas's use of it
+  if(canvas != NULL) {
+    gbitmap_set_palette(canvas, (GColor *)sprite->palette, false);
+    return canvas;
+  }
+  return gbitmap_create_blank_with_palette(GSize(sprite->width, sprite->height), format,
+                                           (GColor *)sprite->palette, false);
+}
+
+void spriteRestart(Sprite *sprite) {
+  sprite->next = 0;
+  sprite->shown = 0;
+}
+
+uint32_t spriteFrameCount(const Sprite *sprite) {
+  return sprite->frameCount;
+}
+
+uint32_t spriteFramesShown(const Sprite *sprite) {
+  return sprite->shown;
+}
+
+bool spriteNextFrame(Sprite *sprite, GBitmap *bitmap, uint32_t *delay) {
+  if(sprite->frameCount == 0) {
+    return false;
+  }
+  if(sprite->next == sprite->frameCount) {
+    sprite->next = 0;
+    sprite->shown = 0;
+  }
+
+  // Look the frame up in the index
+  uint8_t entry[SPRITE_INDEX_ENTRY_SIZE];
+  uint32_t entryOffset = SPRITE_HEADER_SIZE + sprite->paletteSize + sprite->next * SPRITE_INDEX_ENTRY_SIZE;
+  if(resource_load_byte_range(sprite->handle, entryOffset, entry, sizeof(entry)) != sizeof(entry)) {
+    return false;
+  }
+  Reader reader = {
+    .handle = sprite->handle,
+    .pos = read32(entry),
+    .end = read32(entry) + read16(entry + 4)
+  };
+  *delay = read16(entry + 6);
+
+  uint8_t rect[SPRITE_RECT_SIZE];
+  for(int i = 0; i < SPRITE_RECT_SIZE; i++) {
+    if(!readByte(&reader, &rect[i])) {
+      return false;
+    }
+  }
+  GSize size = gbitmap_get_bounds(bitmap).size;
+  if(rect[0] + rect[2] > size.w || rect[1] + rect[3] > size.h ||
+     gbitmap_get_format(bitmap) != canvasFormat(sprite)) {
+    return false;
+  }
+
+  // The first frame is stored against an empty canvas. Index 0 and
+  // GColorClear are both all zero bits
+  uint8_t *data = gbitmap_get_data(bitmap);
+  uint16_t stride = gbitmap_get_bytes_per_row(bitmap);
+  if(sprite->next == 0) {
+    memset(data, 0, size.h * stride);
+  }
+
+  // Unpack the RLE tokens into the changed rectangle, row by row. Palettized
+  // canvases take the indices as they are, 8-bit ones the colours
+  const bool palettized = sprite->bpp < 8;
+  const uint8_t mask = (1 << sprite->bpp) - 1;
+  const uint8_t perByte = 8 / sprite->bpp;
+  uint32_t left = rect[2] * rect[3];
+  uint8_t *row = data + rect[1] * stride;
+  uint8_t x = rect[0];
+  while(left > 0) {
+    uint8_t token;
+    uint8_t packed = 0;
+    if(!readByte(&reader, &token)) {
+      return false;
+    }
+    bool run = token & 0x80;
+    uint32_t count = (token & 0x7F) + 1;
+    uint8_t index = 0;
+    if(run && !readByte(&reader, &index)) {
+      return false;
+    }
+    for(uint32_t i = 0; i < count && left > 0; i++, left--) {
+      if(!run) {
+        uint8_t slot = i % perByte;
+        if(slot == 0 && !readByte(&reader, &packed)) {
+          return false;
+        }
+        index = (packed >> (8 - sprite->bpp * (slot + 1))) & mask;
+      }
+      if(palettized) {
+        uint8_t shift = 8 - sprite->bpp * (x % perByte + 1);
+        uint8_t *byte = &row[x / perByte];
+        *byte = (*byte & ~(mask << shift)) | ((index & mask) << shift);
+      } else if(index < sprite->paletteSize) {
+        row[x] = sprite->palette[index].argb;
+      }
+      if(++x == rect[0] + rect[2]) {
+        x = rect[0];
+        row += stride;
+      }
+    }
+  }
+
+  sprite->next++;
+  sprite->shown++;
+  return true;
+}
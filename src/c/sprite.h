@@ -0,0 +1,31 @@
+#pragma once
+
+#include <pebble.h>
+
+// Animations compiled by tools/spritec.py. Frames are read from the resource
+// one at a time through a small fixed buffer and drawn into a canvas bitmap
+// from spriteCanvas(). Only the part of the canvas that changed since the
+// previous frame is touched, so it must not be modified between frames
+typedef struct Sprite Sprite;
+
+// Returns NULL if the resource isn't a sprite, has more colours than
+// SPRITE_MAX_COLORS or all SPRITE_SLOTS sprites are open
+Sprite *spriteCreate(uint32_t resourceId);
+void spriteDestroy(Sprite *sprite);
+
+// Returns a canvas for the sprite's frames: a palettized bitmap sharing the
+// sprite's palette when it has 16 colours or fewer, otherwise an 8-bit one.
+// canvas is reused if it has the right format and size and destroyed if not,
+// pass NULL to create a new one. Returns NULL if memory ran out
+GBitmap *spriteCanvas(const Sprite *sprite, GBitmap *canvas);
+
+// Start again from the first frame
+void spriteRestart(Sprite *sprite);
+// Draw the next frame into bitmap and return how long to show it in delay.
+// Loops back to the first frame after the last one. Returns false if the
+// frame couldn't be read
+bool spriteNextFrame(Sprite *sprite, GBitmap *bitmap, uint32_t *delay);
+
+uint32_t spriteFrameCount(const Sprite *sprite);
+// Frames shown since the animation (re)started or last looped
+uint32_t spriteFramesShown(const Sprite *sprite);
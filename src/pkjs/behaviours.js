@@ -0,0 +1,25 @@
+// Generated by tools/behavc.py from resources/behaviours.json, do not edit.
+//
+// Behaviour names by id, which are the slots in the performance summary
+module.exports = [
+  'walkleft',
+  'walkright',
+  'walkup',
+  'walkdown',
+  'standing',
+  'sleeping',
+  'shredding',
+  'eating',
+  'invaders',
+  'coffee',
+  'shower',
+  'readpaper',
+  'scare',
+  'sunglasses',
+  'tongueout',
+  'weewee',
+  'balloon',
+  'giftwrap',
+  'gotosleep',
+  'getup'
+];
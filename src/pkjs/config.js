@@ -87,6 +87,28 @@ module.exports = [
         "messageKey": "BatterySaver",
         "label": "Enable battery saver",
         "defaultValue": false
+      },
+      {
+        "type": "toggle",
+        "messageKey": "WristPause",
+        "label": "Pause Boris when nobody is looking",
+        "description": "Boris freezes while the watch is face down or still, a flick of the wrist or a tap wakes him",
+        "defaultValue": false
+      },
+      {
+        "type": "toggle",
+        "messageKey": "CaughtYou",
+        "label": "Boris is startled when you look",
+        "defaultValue": false
+      },
+      {
+        "type": "slider",
+        "messageKey": "BorisCount",
+        "label": "Number of Borises",
+        "defaultValue": 1,
+        "min": 1,
+        "max": 4,
+        "step": 1
       }
     ]
   },
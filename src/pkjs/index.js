@@ -2,19 +2,89 @@
 var Clay = require('pebble-clay');
 // Load our Clay configuration file
 var clayConfig = require('./config');
-// Initialize Clay
-var clay = new Clay(clayConfig);
+// Initialize Clay. The settings are sent to the watch as a packet below
+var clay = new Clay(clayConfig, null, { autoHandleEvents: false });
+
+// The watch and the phone exchange one byte array under the PACKET key.
+// It starts with the protocol version and the packet type, see the PACKET_*
+// layout in main.c
+var PACKET_VERSION = 1;
+var PACKET_WEATHER_REQUEST = 1;
+var PACKET_WEATHER = 2;
+var PACKET_CONFIG = 3;
+var PACKET_PERF = 4;
+var PACKET_FORECAST = 5;
+var PACKET_ICON_NIGHT = 0x80;
+var CONFIG_BATTERY_SAVER = 0x01;
+var CONFIG_WRIST_PAUSE = 0x02;
+var CONFIG_CAUGHT_YOU = 0x04;
+var NO_TIME = 0xFFFF;
+
+// OpenWeatherMap forecast endpoint, readings every three hours. Can be
+// pointed at a local stand-in, see tools/fake-owm.js
+var WEATHER_API = localStorage.getItem('weather-api') ||
+                  'http://api.openweathermap.org/data/2.5/forecast';
+// Forecast readings asked for, enough to cover FORECAST_HOURS from any time
+// within WEATHER_TTL
+var FORECAST_READINGS = 10;
+var FORECAST_STEP = 3 * 60 * 60 * 1000;
+// Hours sent to the watch at once, FORECAST_SLOTS in budget.h. The watch
+// shows them one by one and asks again when they run low
+var FORECAST_HOURS = 24;
+var HOUR = 60 * 60 * 1000;
+// A cached forecast younger than this is sent without asking the server
+var WEATHER_TTL = 3 * 60 * 60 * 1000;
+// Give up on a request after this long
+var WEATHER_TIMEOUT = 15 * 1000;
+// Wait before retrying after a failure, doubled for each failure in a row
+var RETRY_MIN = 60 * 1000;
+var RETRY_MAX = 60 * 60 * 1000;
+
+// The watch keeps the forecast across relaunches, so when it opens an
+// unchanged forecast is only sent again after this long. Requests from the
+// watch are always answered
+var RESEND_AFTER = 60 * 60 * 1000;
+
+var CACHE_KEY = 'weather-cache';
+var RETRY_KEY = 'weather-retry';
+var SENT_KEY = 'weather-sent';
 
 var settings = {};
-try {
-  settings = JSON.parse(localStorage.getItem('clay-settings')) || {};
-} catch (e) {}
+
+// Clay saves the settings whenever they change, so read them every time
+function loadSettings() {
+  try {
+    settings = JSON.parse(localStorage.getItem('clay-settings')) || {};
+  } catch (e) {
+    settings = {};
+  }
+}
+
+function loadJSON(key) {
+  try {
+    return JSON.parse(localStorage.getItem(key));
+  } catch (e) {
+    return null;
+  }
+}
+
+// True while a weather request is running
+var inFlight = false;
+// Last forecast sent to the watch. The watch keeps it when it is reopened,
+// so this is kept across launches too
+var lastSent = loadJSON(SENT_KEY);
+// Set for the send on 'ready', which skips a forecast the watch already has.
+// Anything the watch or the settings ask for clears it, including while a
+// request from 'ready' is still running
+var skipUnchanged = false;
 
 // Listen for when the watchface is opened
-Pebble.addEventListener('ready', 
+Pebble.addEventListener('ready',
   function(e) {
     console.log('PebbleKit JS ready!');
-    // Get the initial weather
+    // Get the initial weather. When the watch was just reopened it still
+    // shows the last reading, then nothing is sent unless it changed
+    skipUnchanged = true;
     getWeather();
   }
 );
@@ -23,51 +93,283 @@ Pebble.addEventListener('ready',
 Pebble.addEventListener('appmessage',
   function(e) {
     console.log('AppMessage received!');
+    var packet = e.payload.PACKET;
+    if(packet && packet[0] === PACKET_VERSION && packet[1] === PACKET_WEATHER_REQUEST) {
+      skipUnchanged = false;
+      getWeather();
+    } else if(packet && packet[0] === PACKET_VERSION && packet[1] === PACKET_PERF) {
+      logPerf(packet);
+    }
+  }
+);
+
+Pebble.addEventListener('showConfiguration',
+  function(e) {
+    Pebble.openURL(clay.generateUrl());
+  }
+);
+
+Pebble.addEventListener('webviewclosed',
+  function(e) {
+    if(!e || !e.response) {
+      return;
+    }
+    // Lets Clay store the new settings
+    clay.getSettings(e.response, false);
+    loadSettings();
+    sendConfig();
+    // The city may have changed
+    skipUnchanged = false;
     getWeather();
-  }                     
+  }
 );
 
-var xhrRequest = function (url, type, callback) {
+// Behaviour slots in the performance summary, generated from
+// resources/behaviours.json by tools/behavc.py
+var PERF_SLOT_NAMES = require('./behaviours');
+
+// Log a summary written by perfWriteSummary() in perf.c
+function logPerf(packet) {
+  var read16 = function(pos) {
+    return packet[pos] | (packet[pos + 1] << 8);
+  };
+  console.log('Perf: ' + read16(2) + 's, heap ' + read16(4) + ' bytes, peak ' + read16(6));
+  for(var pos = 8; pos + 9 <= packet.length; pos += 9) {
+    console.log('Perf: ' + (PERF_SLOT_NAMES[packet[pos]] || packet[pos]) +
+                ' frames ' + read16(pos + 1) + ', wakeups ' + read16(pos + 3) +
+                ', decode ' + read16(pos + 5) + 'ms, draw ' + read16(pos + 7) + 'ms');
+  }
+}
+
+function sendPacket(packet, success, failure) {
+  Pebble.sendAppMessage({ 'PACKET': packet }, success, failure);
+}
+
+// "HH:MM" to minutes since midnight, an empty or bad time turns it off
+function parseMinuteOfDay(text) {
+  var match = /^(\d{1,2}):(\d\d)$/.exec(text || '');
+  if(!match || +match[1] > 23 || +match[2] > 59) {
+    return NO_TIME;
+  }
+  return match[1] * 60 + +match[2];
+}
+
+// 0xRRGGBB to the watch's 2 bits per channel GColor8
+function colorToGColor8(color) {
+  color = +color || 0;
+  return 0xC0 | ((color >> 22) & 0x03) << 4 | ((color >> 14) & 0x03) << 2 | ((color >> 6) & 0x03);
+}
+
+function sendConfig() {
+  var bedtime = parseMinuteOfDay(settings.Bedtime);
+  var getUpTime = parseMinuteOfDay(settings.GetUpTime);
+  sendPacket([
+    PACKET_VERSION, PACKET_CONFIG,
+    (settings.BatterySaver ? CONFIG_BATTERY_SAVER : 0) |
+    (settings.WristPause ? CONFIG_WRIST_PAUSE : 0) |
+    (settings.CaughtYou ? CONFIG_CAUGHT_YOU : 0),
+    colorToGColor8(settings.BackgroundColor),
+    bedtime & 0xFF, bedtime >> 8,
+    getUpTime & 0xFF, getUpTime >> 8,
+    parseInt(settings.BorisCount, 10) || 1
+  ],
+    function(e) {
+      console.log('Settings sent to Pebble successfully!');
+    },
+    function(e) {
+      console.log('Error sending settings to Pebble!');
+    }
+  );
+}
+
+// OpenWeatherMap icon, eg. "10n", to the condition number with the night bit
+function iconToByte(icon) {
+  var condition = parseInt(icon, 10);
+  if(!(condition > 0 && condition < PACKET_ICON_NIGHT)) {
+    return 0;
+  }
+  return condition | (icon.charAt(2) === 'n' ? PACKET_ICON_NIGHT : 0);
+}
+
+var xhrRequest = function (url, type, headers, callback) {
   var xhr = new XMLHttpRequest();
+  var done = false;
+  var finish = function (status) {
+    if(!done) {
+      done = true;
+      callback(status, xhr);
+    }
+  };
   xhr.onload = function () {
-    callback(this.responseText);
+    finish(this.status);
+  };
+  xhr.onerror = function () {
+    finish(0);
+  };
+  xhr.ontimeout = function () {
+    finish(0);
   };
   xhr.open(type, url);
+  xhr.timeout = WEATHER_TIMEOUT;
+  for(var name in headers) {
+    xhr.setRequestHeader(name, headers[name]);
+  }
   xhr.send();
 };
 
+// The readings for every hour from this one on, as far as the forecast
+// goes. Temperatures are interpolated between the three-hourly readings, the
+// icon is the one of the reading the hour falls in
+function forecastPacket(weather) {
+  var now = Date.now();
+  var start = Math.floor(now / HOUR) * HOUR;
+  var packet = [PACKET_VERSION, PACKET_FORECAST];
+  var seconds = start / 1000;
+  for(var b = 0; b < 4; b++) {
+    packet.push(Math.floor(seconds / Math.pow(256, b)) & 0xFF);
+  }
+  var readings = weather.readings;
+  var j = 0;
+  for(var hour = 0; hour < FORECAST_HOURS; hour++) {
+    var time = start + hour * HOUR;
+    while(j + 1 < readings.length && readings[j + 1].time <= time) {
+      j++;
+    }
+    var reading = readings[j];
+    var next = readings[j + 1];
+    if(!next && time >= reading.time + FORECAST_STEP) {
+      break;
+    }
+    var temperature = reading.temperature;
+    if(next && time > reading.time) {
+      temperature += (next.temperature - reading.temperature) * (time - reading.time) / (next.time - reading.time);
+    }
+    // Temperature as a signed byte
+    temperature = Math.max(-128, Math.min(127, Math.round(temperature)));
+    packet.push(temperature & 0xFF, iconToByte(reading.icon));
+  }
+  return packet;
+}
+
+function sendWeather(weather) {
+  var packet = forecastPacket(weather);
+  // The watch already has this
+  if(skipUnchanged && lastSent && lastSent.packet === packet.join(',') &&
+     Date.now() - lastSent.time < RESEND_AFTER) {
+    return;
+  }
+  lastSent = { packet: packet.join(','), time: Date.now() };
+  localStorage.setItem(SENT_KEY, JSON.stringify(lastSent));
+
+  // Send to Pebble
+  sendPacket(packet,
+    function(e) {
+      console.log('Weather forecast sent to Pebble successfully!');
+    },
+    function(e) {
+      console.log('Error sending weather forecast to Pebble!');
+      lastSent = null;
+      localStorage.removeItem(SENT_KEY);
+    }
+  );
+}
+
 function getWeather() {
-  // Construct URL
-  var url = 'http://api.openweathermap.org/data/2.5/weather?q=' + settings.WeatherCity + '&appid=' + settings.WeatherKey;
+  loadSettings();
+  if(!settings.WeatherCity || !settings.WeatherKey) {
+    return;
+  }
+  var query = encodeURIComponent(settings.WeatherCity) + '&appid=' + encodeURIComponent(settings.WeatherKey);
+  var cached = loadJSON(CACHE_KEY);
+  // Caches from before the forecast held a single reading
+  if(cached && (cached.query !== query || !cached.readings)) {
+    cached = null;
+  }
+  var now = Date.now();
+
+  // Fresh enough, no need to wake the radio
+  if(cached && now - cached.time < WEATHER_TTL) {
+    sendWeather(cached);
+    return;
+  }
+
+  // Still backing off after a failure, make do with what we have
+  var retry = loadJSON(RETRY_KEY);
+  if(retry && retry.query === query && now < retry.at) {
+    console.log('Weather request backing off for ' + Math.round((retry.at - now) / 1000) + 's');
+    if(cached) {
+      sendWeather(cached);
+    }
+    return;
+  }
+
+  // Somebody already asked, the result will be sent when it arrives
+  if(inFlight) {
+    return;
+  }
+  inFlight = true;
+
+  // Let the server tell us nothing changed since the cached copy
+  var headers = {};
+  if(cached && cached.etag) {
+    headers['If-None-Match'] = cached.etag;
+  }
+  if(cached && cached.lastModified) {
+    headers['If-Modified-Since'] = cached.lastModified;
+  }
 
   // Send request to OpenWeatherMap
-  xhrRequest(url, 'GET', 
-    function(responseText) {
-      // responseText contains a JSON object with weather info
-      var json = JSON.parse(responseText);
-
-      // Temperature in Kelvin requires adjustment
-      var temperature = Math.round(json.main.temp - 273.15);
-      console.log('Temperature is ' + temperature);
-
-      // Conditions
-      var icon = json.weather[0].icon;      
-      console.log('Weather icon is ' + icon);
-      // Assemble dictionary using our keys
-      var dictionary = {
-        'TEMPERATURE': temperature,
-        'ICON': icon
-      };
-
-      // Send to Pebble
-      Pebble.sendAppMessage(dictionary,
-        function(e) {
-          console.log('Weather info sent to Pebble successfully!');
-        },
-        function(e) {
-          console.log('Error sending weather info to Pebble!');
+  xhrRequest(WEATHER_API + '?q=' + query + '&cnt=' + FORECAST_READINGS, 'GET', headers,
+    function(status, xhr) {
+      inFlight = false;
+      var weather = null;
+      if(status === 304 && cached) {
+        weather = cached;
+      } else if(status === 200) {
+        try {
+          // responseText contains a JSON object with a list of readings
+          var json = JSON.parse(xhr.responseText);
+          weather = {
+            query: query,
+            readings: json.list.map(function(reading) {
+              return {
+                time: reading.dt * 1000,
+                // Temperature in Kelvin requires adjustment
+                temperature: reading.main.temp - 273.15,
+                // Conditions
+                icon: reading.weather[0].icon
+              };
+            }),
+            etag: xhr.getResponseHeader('ETag'),
+            lastModified: xhr.getResponseHeader('Last-Modified')
+          };
+          if(!weather.readings.length) {
+            weather = null;
+          }
+        } catch (e) {
+          weather = null;
         }
-      );
-    }      
+      }
+
+      if(!weather) {
+        // Wait twice as long after every failure in a row
+        var failures = retry && retry.query === query ? retry.failures + 1 : 1;
+        var wait = Math.min(RETRY_MIN * Math.pow(2, failures - 1), RETRY_MAX);
+        localStorage.setItem(RETRY_KEY, JSON.stringify({
+          query: query, failures: failures, at: Date.now() + wait
+        }));
+        console.log('Weather request failed (' + status + '), retrying in ' + wait / 1000 + 's');
+        if(cached) {
+          sendWeather(cached);
+        }
+        return;
+      }
+
+      weather.time = Date.now();
+      localStorage.setItem(CACHE_KEY, JSON.stringify(weather));
+      localStorage.removeItem(RETRY_KEY);
+      console.log('Forecast has ' + weather.readings.length + ' readings');
+      sendWeather(weather);
+    }
   );
-}
\ No newline at end of file
+}
@@ -0,0 +1,89 @@
+# Minimal APNG decoder used by the sprite compiler.
+#
+# Frames are composited the way a viewer shows them, honouring the fcTL
+# dispose and blend operations, so every frame returned is a complete image.
+
+import struct
+import zlib
+
+import pngfile
+
+DISPOSE_NONE, DISPOSE_BACKGROUND, DISPOSE_PREVIOUS = 0, 1, 2
+BLEND_SOURCE, BLEND_OVER = 0, 1
+
+
+class FrameControl(object):
+    def __init__(self, body):
+        (_, self.width, self.height, self.x, self.y, delay_num, delay_den,
+         self.dispose, self.blend) = struct.unpack('>IIIIIHHBB', body)
+        # A zero denominator means hundredths of a second
+        self.delay = int(round(1000.0 * delay_num / (delay_den or 100)))
+
+
+def _blend(under, over):
+    a = over[3]
+    if a == 255 or under[3] == 0:
+        return over
+    if a == 0:
+        return under
+    out_a = a + under[3] * (255 - a) // 255
+    return tuple((over[i] * a + under[i] * under[3] * (255 - a) // 255) // out_a
+                 for i in range(3)) + (out_a,)
+
+
+def read(path):
+    """Read an APNG. Returns (width, height, [(pixels, delay_ms), ...]).
+
+    A plain PNG is returned as a single frame with no delay."""
+    with open(path, 'rb') as f:
+        data = f.read()
+    header = None
+    palette, trns = [], b''
+    # (FrameControl or None, compressed data) in file order
+    parts = []
+    control = None
+    for kind, body in pngfile.read_chunks(data):
+        if kind == b'IHDR':
+            header = pngfile.Header(body)
+        elif kind == b'PLTE':
+            palette = pngfile.read_palette(body)
+        elif kind == b'tRNS':
+            trns = body
+        elif kind == b'fcTL':
+            control = FrameControl(body)
+            parts.append([control, b''])
+        elif kind == b'IDAT':
+            # The default image is only part of the animation if a fcTL
+            # came before it
+            if not parts or parts[-1][0] is not control or control is None:
+                parts.append([control, b''])
+            parts[-1][1] += body
+        elif kind == b'fdAT':
+            parts[-1][1] += body[4:]
+
+    width, height = header.width, header.height
+    clear = (0, 0, 0, 0)
+    canvas = [clear] * (width * height)
+    frames = []
+    for control, compressed in parts:
+        if control is None:
+            continue
+        rows = pngfile.unfilter(zlib.decompress(compressed), control.width, control.height, header.bpp)
+        pixels = pngfile.to_rgba(header, rows, control.width, control.height, palette, trns)
+        before = list(canvas)
+        for y in range(control.height):
+            for x in range(control.width):
+                pos = (control.y + y) * width + control.x + x
+                src = pixels[y * control.width + x]
+                canvas[pos] = src if control.blend == BLEND_SOURCE else _blend(canvas[pos], src)
+        frames.append((list(canvas), control.delay))
+        if control.dispose == DISPOSE_BACKGROUND:
+            for y in range(control.height):
+                for x in range(control.width):
+                    canvas[(control.y + y) * width + control.x + x] = clear
+        elif control.dispose == DISPOSE_PREVIOUS:
+            canvas = before
+    if not frames:
+        _, _, pixels = pngfile.read(path)
+        frames.append((pixels, 0))
+    return width, height, frames
@@ -0,0 +1,190 @@
+# Compiles resources/behaviours.json into src/c/behaviours.h, the const
+# behaviour table the watchface runs from, and src/pkjs/behaviours.js, the
+# behaviour names index.js labels the performance summary with.
+#
+# The manifest is a list of behaviours. Their order gives the behaviour ids,
+# and the ids are the slots in the performance summary too. Each entry has:
+#
+#   name        the sprite in resources/sprites, and the C name in capitals.
+#               The resource of the same name must be listed in package.json
+#   mirror      the behaviour this one is, flipped left to right. It is shown
+#               from that behaviour's sprite, so it has no sprite or resource
+#               of its own. Its APNG is kept as the artwork and checked
+#   weight      fun weight for the random pick, 0 or left out for behaviours
+#               Boris is only ever sent into
+#   oneShot     play once and move on, instead of looping for a random time
+#   step        [dx, dy] pixels moved per frame, as the walks were drawn
+#   pinned      keep the decoder open, for the behaviours picked most often
+#   next        behaviour that always follows this one, instead of a random
+#               pick
+#   nextAsleep  the next behaviour lasts until Boris is woken up
+#
+# The frame count, the length of one play and its energy are measured from
+# the compiled sprites with spritec.measure(). The step is turned into a
+# speed in fixed point pixels per second, so Boris walks as fast whatever
+# frame rate he is shown at.
+#
+# Building also looks for APNGs in resources/data that are another one
+# flipped but not marked as a mirror yet, and says so.
+
+import json
+import os
+import sys
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+import apng
+import spritec
+
+# FIXED_ONE in src/c/main.c
+FIXED_ONE = 256
+NO_NEXT = 0xff
+
+
+def sprite_name(b):
+    return b.get('mirror', b['name'])
+
+
+def sources(manifest, sprite_dir):
+    with open(manifest) as f:
+        behaviours = json.load(f)
+    return behaviours, [os.path.join(sprite_dir, sprite_name(b) + '.bin') for b in behaviours]
+
+
+def mirrors(manifest):
+    """Names of the behaviours that are shown flipped and need no sprite."""
+    with open(manifest) as f:
+        return set(b['name'] for b in json.load(f) if 'mirror' in b)
+
+
+def apng_dir(sprite_dir):
+    """resources/data, where the sprites are compiled from."""
+    return os.path.join(os.path.dirname(os.path.abspath(sprite_dir)), 'data')
+
+
+def needs_update(manifest, sprite_dir, *targets):
+    if not all(os.path.exists(target) for target in targets):
+        return True
+    mtime = min(os.path.getmtime(target) for target in targets)
+    behaviours, sprites = sources(manifest, sprite_dir)
+    # Mirrors have no sprite, their artwork is checked instead
+    artwork = [os.path.join(apng_dir(sprite_dir), b['name'] + '.png') for b in behaviours if 'mirror' in b]
+    return any(os.path.getmtime(path) > mtime for path in [manifest, os.path.abspath(__file__)] + sprites +
+               [path for path in artwork if os.path.exists(path)])
+
+
+def check(behaviours, resources):
+    names = [b['name'] for b in behaviours]
+    for b in behaviours:
+        if 'mirror' in b:
+            if b['mirror'] not in names or 'mirror' in behaviours[names.index(b['mirror'])]:
+                raise ValueError('{} mirrors {}, which has no sprite'.format(b['name'], b['mirror']))
+        elif b['name'].upper() not in resources:
+            raise ValueError('{} has no resource in package.json'.format(b['name']))
+        if 'next' in b and b['next'] not in names:
+            raise ValueError('{} is followed by unknown behaviour {}'.format(b['name'], b['next']))
+        # A chain of successors must end, the watch follows it to cost a pick
+        seen = set()
+        cur = b
+        while 'next' in cur:
+            if cur['name'] in seen:
+                raise ValueError('{} never stops being followed'.format(b['name']))
+            seen.add(cur['name'])
+            cur = behaviours[names.index(cur['next'])]
+    if len(behaviours) >= NO_NEXT:
+        raise ValueError('too many behaviours')
+
+
+def check_mirrors(behaviours, apng_dir):
+    """Fails if a mirror's artwork has drifted from the behaviour it mirrors,
+    and points out behaviours that could be mirrors."""
+    animations = {}
+    for b in behaviours:
+        path = os.path.join(apng_dir, b['name'] + '.png')
+        if os.path.exists(path):
+            animations[b['name']] = apng.read(path)
+    for b in behaviours:
+        if 'mirror' in b and b['name'] in animations and b['mirror'] in animations and \
+           not spritec.mirrored(animations[b['mirror']], animations[b['name']]):
+            raise ValueError('{}.png no longer mirrors {}.png, give it its own sprite'.format(b['name'], b['mirror']))
+    plain = [b['name'] for b in behaviours if 'mirror' not in b and b['name'] in animations]
+    for i, source in enumerate(plain):
+        for other in plain[i + 1:]:
+            if spritec.mirrored(animations[source], animations[other]):
+                print('behavc: {} is {} flipped, it could be "mirror": "{}"'.format(other, source, source))
+
+
+def write_names(names, target):
+    lines = ['// Generated by tools/behavc.py from resources/behaviours.json, do not edit.',
+             '//',
+             '// Behaviour names by id, which are the slots in the performance summary',
+             'module.exports = [']
+    lines += ["  '{}',".format(name) for name in names]
+    lines[-1] = lines[-1].rstrip(',')
+    lines.append('];')
+    with open(target, 'w') as f:
+        f.write('\n'.join(lines) + '\n')
+
+
+def build(manifest, sprite_dir, package, target, names_target=None):
+    behaviours, sprites = sources(manifest, sprite_dir)
+    with open(package) as f:
+        check(behaviours, set(r['name'] for r in json.load(f)['pebble']['resources']['media']))
+    check_mirrors(behaviours, apng_dir(sprite_dir))
+    names = [b['name'] for b in behaviours]
+    lines = ['// Generated by tools/behavc.py from resources/behaviours.json, do not edit.',
+             '//',
+             '// For each behaviour: the resource, frame count, length of one play in ms',
+             '// and the energy it takes in the host simulator\'s units, fun weight for the',
+             '// random pick, BEHAV_* flags, the behaviour that always follows it or',
+             '// BEHAV_NO_NEXT, and how fast Boris moves in it. BEHAV_MIRRORED ones are',
+             '// drawn flipped from another behaviour\'s resource',
+             '#pragma once',
+             '']
+    for i, name in enumerate(names):
+        lines.append('#define {} {}'.format(name.upper(), i))
+    lines += ['#define BEHAV_COUNT {}'.format(len(names)),
+              '',
+              '#define BEHAV_ONE_SHOT 0x01',
+              '#define BEHAV_PINNED 0x02',
+              '#define BEHAV_NEXT_ASLEEP 0x04',
+              '#define BEHAV_MIRRORED 0x08',
+              '#define BEHAV_NO_NEXT 0x{:02X}'.format(NO_NEXT),
+              '',
+              'typedef struct BehavInfo {',
+              '  uint32_t resource;',
+              '  uint8_t frames;',
+              '  uint8_t weight;',
+              '  uint8_t flags;',
+              '  uint8_t next;',
+              '  uint16_t ms;',
+              '  uint16_t cost;',
+              '  // Fixed point pixels per second',
+              '  int16_t vx;',
+              '  int16_t vy;',
+              '} BehavInfo;',
+              '',
+              'static const BehavInfo behavInfos[BEHAV_COUNT] = {']
+    for b, sprite in zip(behaviours, sprites):
+        with open(sprite, 'rb') as f:
+            frames, duration, energy = spritec.measure(f.read())
+        flags = [flag for key, flag in (('oneShot', 'BEHAV_ONE_SHOT'), ('pinned', 'BEHAV_PINNED'),
+                                        ('nextAsleep', 'BEHAV_NEXT_ASLEEP'), ('mirror', 'BEHAV_MIRRORED'))
+                 if b.get(key)]
+        dx, dy = b.get('step', (0, 0))
+        # Rounded toward zero, as C would
+        speed = [(1 if d >= 0 else -1) * (abs(d) * frames * FIXED_ONE * 1000 // duration) for d in (dx, dy)]
+        fields = ['RESOURCE_ID_' + sprite_name(b).upper(), str(frames), str(b.get('weight', 0)),
+                  ' | '.join(flags) or '0',
+                  b['next'].upper() if 'next' in b else 'BEHAV_NO_NEXT',
+                  str(duration), str(energy), str(speed[0]), str(speed[1])]
+        lines.append('  [{}] = {{ {} }},'.format(b['name'].upper(), ', '.join(fields)))
+    lines[-1] = lines[-1].rstrip(',')
+    lines.append('};')
+    with open(target, 'w') as f:
+        f.write('\n'.join(lines) + '\n')
+    if names_target:
+        write_names(names, names_target)
+
+
+if __name__ == '__main__':
+    build(*sys.argv[1:6])
@@ -0,0 +1,277 @@
+#!/usr/bin/env node
+// Local stand-in for the OpenWeatherMap forecast endpoint, so the phone side
+// weather cache can be tried without a network or an API key.
+//
+//   node tools/fake-owm.js [--port 8080] [--fail N] [--delay MS]
+//
+// Point the watchface at it by setting localStorage 'weather-api' to
+// http://<host>:<port>/data/2.5/forecast in the PebbleKit JS console.
+//
+//   node tools/fake-owm.js --check
+//
+// runs src/pkjs/index.js against the stand-in with a stubbed Pebble
+// environment and checks caching, request merging, back-off and the hourly
+// forecast packet.
+
+var http = require('http');
+var fs = require('fs');
+var path = require('path');
+var vm = require('vm');
+
+var options = { port: 8080, fail: 0, delay: 0, check: false };
+for(var i = 2; i < process.argv.length; i++) {
+  var arg = process.argv[i];
+  if(arg === '--port') {
+    options.port = parseInt(process.argv[++i], 10);
+  } else if(arg === '--fail') {
+    options.fail = parseInt(process.argv[++i], 10);
+  } else if(arg === '--delay') {
+    options.delay = parseInt(process.argv[++i], 10);
+  } else if(arg === '--check') {
+    options.check = true;
+  } else {
+    console.error('Usage: fake-owm.js [--port N] [--fail N] [--delay MS] [--check]');
+    process.exit(2);
+  }
+}
+
+var ICONS = ['01d', '02d', '03d', '04n', '09d', '10n', '11d', '13d', '50d'];
+
+var stats = { requests: 0, notModified: 0, failed: 0 };
+// The weather only changes every ten minutes, like the real thing
+var PERIOD = 10 * 60 * 1000;
+
+// Readings every three hours from the next three hour mark, like the real
+// thing
+var STEP = 3 * 60 * 60;
+
+function weatherFor(city, period, count) {
+  var seed = period;
+  for(var i = 0; i < city.length; i++) {
+    seed = (seed * 31 + city.charCodeAt(i)) % 1000003;
+  }
+  var first = (Math.floor(Date.now() / 1000 / STEP) + 1) * STEP;
+  var list = [];
+  for(var j = 0; j < count; j++) {
+    seed = (seed * 31 + j) % 1000003;
+    list.push({
+      dt: first + j * STEP,
+      main: { temp: 263.15 + seed % 30 },
+      weather: [{ icon: ICONS[seed % ICONS.length] }]
+    });
+  }
+  return { city: { name: city }, cnt: count, list: list };
+}
+
+function createServer() {
+  return http.createServer(function(req, res) {
+    var url = new URL(req.url, 'http://localhost');
+    stats.requests++;
+    setTimeout(function() {
+      if(url.pathname !== '/data/2.5/forecast') {
+        res.writeHead(404);
+        res.end();
+        return;
+      }
+      if(options.fail > 0) {
+        options.fail--;
+        stats.failed++;
+        res.writeHead(503);
+        res.end();
+        return;
+      }
+      var period = Math.floor(Date.now() / PERIOD);
+      var etag = '"' + (url.searchParams.get('q') || '') + '-' + period + '"';
+      if(req.headers['if-none-match'] === etag) {
+        stats.notModified++;
+        res.writeHead(304, { 'ETag': etag });
+        res.end();
+        return;
+      }
+      res.writeHead(200, { 'Content-Type': 'application/json', 'ETag': etag });
+      res.end(JSON.stringify(weatherFor(url.searchParams.get('q') || '', period,
+                                        parseInt(url.searchParams.get('cnt'), 10) || 40)));
+    }, options.delay);
+  });
+}
+
+// Just enough of XMLHttpRequest for index.js
+function FakeXMLHttpRequest() {
+  this.headers = {};
+  this.timeout = 0;
+}
+FakeXMLHttpRequest.prototype.open = function(method, url) {
+  this.method = method;
+  this.url = url;
+};
+FakeXMLHttpRequest.prototype.setRequestHeader = function(name, value) {
+  this.headers[name] = value;
+};
+FakeXMLHttpRequest.prototype.getResponseHeader = function(name) {
+  return this.response ? this.response.headers[name.toLowerCase()] || null : null;
+};
+FakeXMLHttpRequest.prototype.send = function() {
+  var xhr = this;
+  var req = http.request(xhr.url, { method: xhr.method, headers: xhr.headers }, function(res) {
+    var body = '';
+    res.on('data', function(chunk) {
+      body += chunk;
+    });
+    res.on('end', function() {
+      xhr.response = res;
+      xhr.status = res.statusCode;
+      xhr.responseText = body;
+      xhr.onload.call(xhr);
+    });
+  });
+  if(xhr.timeout) {
+    req.setTimeout(xhr.timeout, function() {
+      req.destroy();
+      xhr.ontimeout();
+    });
+  }
+  req.on('error', function() {
+    xhr.onerror();
+  });
+  req.end();
+};
+
+function check(port) {
+  var storage = {};
+  var listeners = {};
+  var sent = [];
+  var clock = Date.now();
+  var localStorage = {
+    getItem: function(key) {
+      return key in storage ? storage[key] : null;
+    },
+    setItem: function(key, value) {
+      storage[key] = String(value);
+    },
+    removeItem: function(key) {
+      delete storage[key];
+    }
+  };
+  localStorage.setItem('weather-api', 'http://localhost:' + port + '/data/2.5/forecast');
+  localStorage.setItem('clay-settings', JSON.stringify({ WeatherCity: 'Copenhagen', WeatherKey: 'key' }));
+
+  var context = {
+    console: { log: function() {} },
+    localStorage: localStorage,
+    XMLHttpRequest: FakeXMLHttpRequest,
+    JSON: JSON,
+    Math: Math,
+    Date: { now: function() { return clock; } },
+    encodeURIComponent: encodeURIComponent,
+    Pebble: {
+      addEventListener: function(name, callback) {
+        listeners[name] = callback;
+      },
+      sendAppMessage: function(dict, success) {
+        sent.push(dict);
+        success({});
+      }
+    },
+    require: function(name) {
+      return name === 'pebble-clay' ? function() {} : {};
+    }
+  };
+  var source = fs.readFileSync(path.join(__dirname, '..', 'src', 'pkjs', 'index.js'), 'utf8');
+  vm.runInNewContext(source, context);
+
+  // What the watch sends when its forecast runs low, see the PACKET_* layout
+  // in main.c
+  var WEATHER_REQUEST = { payload: { PACKET: [1, 1] } };
+
+  var failures = 0;
+  function expect(what, actual, expected) {
+    var ok = actual === expected;
+    console.log((ok ? 'ok   ' : 'FAIL ') + what + ': ' + actual + (ok ? '' : ' (expected ' + expected + ')'));
+    failures += ok ? 0 : 1;
+  }
+  // Let a request reach the server and come back
+  function settle(next) {
+    setTimeout(next, options.delay + 100);
+  }
+
+  var steps = [
+    function() {
+      // The watch opening and asking straight away is a single request
+      listeners.ready({});
+      listeners.appmessage(WEATHER_REQUEST);
+      listeners.appmessage(WEATHER_REQUEST);
+    },
+    function() {
+      expect('merged requests', stats.requests, 1);
+      expect('messages to the watch', sent.length, 1);
+      var packet = sent[0].PACKET;
+      var start = packet[2] + packet[3] * 256 + packet[4] * 65536 + packet[5] * 16777216;
+      expect('forecast packet', packet.slice(0, 2).join(','), '1,5');
+      expect('forecast starts this hour', start, Math.floor(clock / 3600000) * 3600);
+      expect('forecast hours', (packet.length - 6) / 2, 24);
+      // Within the TTL the watch is answered from the cache
+      clock += 5 * 60 * 1000;
+      listeners.appmessage(WEATHER_REQUEST);
+    },
+    function() {
+      expect('requests within TTL', stats.requests, 1);
+      expect('answers within TTL', sent.length, 2);
+      // Reopening the watchface doesn't send a forecast it already has
+      listeners.ready({});
+    },
+    function() {
+      expect('requests on reopening', stats.requests, 1);
+      expect('messages on reopening', sent.length, 2);
+      // After the TTL the server is asked again
+      clock += 3 * 60 * 60 * 1000;
+      options.fail = 2;
+      listeners.appmessage(WEATHER_REQUEST);
+    },
+    function() {
+      expect('request after TTL', stats.requests, 2);
+      // Failed, so the next one waits
+      listeners.appmessage(WEATHER_REQUEST);
+    },
+    function() {
+      expect('requests while backing off', stats.requests, 2);
+      clock += 61 * 1000;
+      listeners.appmessage(WEATHER_REQUEST);
+    },
+    function() {
+      expect('retry after a minute', stats.requests, 3);
+      // Second failure in a row doubles the wait
+      clock += 61 * 1000;
+      listeners.appmessage(WEATHER_REQUEST);
+    },
+    function() {
+      expect('requests before doubled wait', stats.requests, 3);
+      clock += 60 * 1000;
+      listeners.appmessage(WEATHER_REQUEST);
+    },
+    function() {
+      expect('retry after two minutes', stats.requests, 4);
+      expect('failed requests', stats.failed, 2);
+      expect('back-off cleared', localStorage.getItem('weather-retry'), null);
+    }
+  ];
+
+  var step = 0;
+  (function run() {
+    steps[step++]();
+    if(step < steps.length) {
+      settle(run);
+    } else {
+      process.exit(failures ? 1 : 0);
+    }
+  })();
+}
+
+var server = createServer();
+server.listen(options.check ? 0 : options.port, function() {
+  var port = server.address().port;
+  if(options.check) {
+    check(port);
+  } else {
+    console.log('Fake OpenWeatherMap listening on http://localhost:' + port + '/data/2.5/forecast');
+  }
+});
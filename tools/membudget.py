@@ -0,0 +1,154 @@
+# Reports the memory the watchface keeps while its window is open and checks
+# it against MEMORY_BUDGET in src/c/budget.h.
+#
+# Static variables, the pools among them, are read from the symbol tables of
+# the compiled watchface: the linked app, or its object files. Their sizes
+# are the compiler's own, for whichever target it built for. What is
+# allocated on the heap is worked out from the sizes in budget.h and the
+# compiled resources, each at its ceiling: every slot taken, by the largest
+# sprite that can use it. Those figures are for colour watches, whose sprites
+# and icons take more room than the black and white ~bw variants. The SDK's
+# own objects (layers, fonts, GBitmap headers, the AppMessage buffers) are
+# not counted, the host simulator's peak heap includes them.
+
+import json
+import os
+import re
+import struct
+import sys
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+import behavc
+import pngfile
+
+# Statics smaller than this are reported together
+STATIC_ROW_MIN = 64
+
+SHT_SYMTAB = 2
+SHF_WRITE = 0x1
+SHF_ALLOC = 0x2
+SHN_COMMON = 0xfff2
+STT_OBJECT = 1
+
+
+def read_defines(path):
+    """The #defines of a header, evaluated in order."""
+    defines = {}
+    with open(path) as f:
+        for line in f:
+            m = re.match(r'#define\s+(\w+)\s+(.+?)\s*(//.*)?$', line)
+            if m:
+                defines[m.group(1)] = eval(m.group(2), {}, dict(defines))
+    return defines
+
+
+def canvas_bytes(bpp, width, height):
+    """Bytes of a canvas for a sprite, palettized unless it is 8-bit."""
+    return (width * bpp + 7) // 8 * height
+
+
+def read_sprite(path):
+    with open(path, 'rb') as f:
+        bpp, width, height, frames, colors = struct.unpack('<BBBBB', f.read(8)[3:8])
+    return bpp, width, height, frames, colors
+
+
+def read_statics(path):
+    """[(name, bytes)] of the writable data objects in an ELF file, the
+    .data and .bss a program keeps for as long as it runs."""
+    with open(path, 'rb') as f:
+        elf = f.read()
+    if elf[:4] != b'\x7fELF':
+        raise ValueError('{} is not an ELF file'.format(path))
+    wide = elf[4] == 2
+    order = '<' if elf[5] == 1 else '>'
+    if wide:
+        shoff, = struct.unpack_from(order + 'Q', elf, 0x28)
+        shentsize, shnum = struct.unpack_from(order + 'HH', elf, 0x3a)
+        section_format, symbol_format = 'IIQQQQIIQQ', 'IBBHQQ'
+    else:
+        shoff, = struct.unpack_from(order + 'I', elf, 0x20)
+        shentsize, shnum = struct.unpack_from(order + 'HH', elf, 0x2e)
+        section_format, symbol_format = 'IIIIIIIIII', 'IIIBBH'
+    # (type, flags, offset, size, link, entsize) of every section
+    sections = []
+    for i in range(shnum):
+        fields = struct.unpack_from(order + section_format, elf, shoff + i * shentsize)
+        sections.append((fields[1], fields[2], fields[4], fields[5], fields[6], fields[9]))
+    statics = []
+    for kind, _, offset, size, link, entsize in sections:
+        if kind != SHT_SYMTAB:
+            continue
+        strings = sections[link][2]
+        for pos in range(offset + entsize, offset + size, entsize):
+            if wide:
+                name, info, _, shndx, _, length = struct.unpack_from(order + symbol_format, elf, pos)
+            else:
+                name, _, length, info, _, shndx = struct.unpack_from(order + symbol_format, elf, pos)
+            if info & 0xf != STT_OBJECT or length == 0:
+                continue
+            if shndx != SHN_COMMON and (shndx >= len(sections) or
+                                        sections[shndx][1] & (SHF_WRITE | SHF_ALLOC) != SHF_WRITE | SHF_ALLOC):
+                continue
+            end = elf.index(b'\0', strings + name)
+            statics.append((elf[strings + name:end].decode(), length))
+    return statics
+
+
+def atlas_bytes(path):
+    """The weather atlas as the SDK loads it, at the fewest bits per pixel
+    for its colours."""
+    width, height, pixels = pngfile.read(path)
+    colors = len(set((r >> 6, g >> 6, b >> 6, a >> 6) for r, g, b, a in pixels))
+    bpp = next((b for b in (1, 2, 4) if colors <= 1 << b), 8)
+    return canvas_bytes(bpp, width, height)
+
+
+def measure(root, objects):
+    """Returns [(subsystem, bytes, how)] and the budget, for the compiled
+    watchface in objects."""
+    d = read_defines(os.path.join(root, 'src', 'c', 'budget.h'))
+    with open(os.path.join(root, 'resources', 'behaviours.json')) as f:
+        behaviours = json.load(f)
+    sprites = [(b, read_sprite(os.path.join(root, 'resources', 'sprites', behavc.sprite_name(b) + '.bin')))
+               for b in behaviours]
+
+    canvas = max(canvas_bytes(bpp, w, h) for _, (bpp, w, h, _, _) in sprites)
+    # Rings only take short loops with a palettized canvas
+    ring_frame = max([canvas_bytes(bpp, w, h) for b, (bpp, w, h, frames, _) in sprites
+                      if not b.get('oneShot') and frames <= d['FRAME_RING_MAX_FRAMES'] and
+                      1 << bpp <= d['FRAME_RING_COLORS']] or [0])
+    ring_frames = d['FRAME_RINGS'] * d['FRAME_RING_MAX_FRAMES']
+
+    rows = [
+        ('player canvases', d['PLAYER_SLOTS'] * canvas, '{} x {}'.format(d['PLAYER_SLOTS'], canvas)),
+        ('frame rings', ring_frames * ring_frame, '{} x {}'.format(ring_frames, ring_frame)),
+        ('text cache', d['TEXT_CACHE_BYTES'], ''),
+        ('weather icons', atlas_bytes(os.path.join(root, 'resources', 'images', 'weather.png')), ''),
+    ]
+    statics = sorted((s for path in objects for s in read_statics(path)), key=lambda s: -s[1])
+    rows += [(name, size, 'static') for name, size in statics if size >= STATIC_ROW_MIN]
+    small = [size for _, size in statics if size < STATIC_ROW_MIN]
+    rows.append(('other statics', sum(small), '{} of them'.format(len(small))))
+    return rows, d['MEMORY_BUDGET']
+
+
+def report(root, objects):
+    """Returns the report and whether it is within the budget."""
+    rows, budget = measure(root, objects)
+    total = sum(size for _, size, _ in rows)
+    lines = ['Memory budget (colour watches, bytes)']
+    lines += ['  {:<28} {:>10} {:>7}'.format(name, how, size) for name, size, how in rows]
+    lines.append('  {:<28} {:>10} {:>7} of {}'.format('total', '', total, budget))
+    return '\n'.join(lines), total <= budget
+
+
+if __name__ == '__main__':
+    if len(sys.argv) < 3:
+        print('Usage: membudget.py <repository> <app elf or object files>...')
+        sys.exit(2)
+    text, ok = report(sys.argv[1], sys.argv[2:])
+    print(text)
+    if not ok:
+        print('Over budget, see src/c/budget.h')
+        sys.exit(1)
@@ -0,0 +1,143 @@
+# Minimal PNG reader/writer used by the resource build steps.
+#
+# Only what the BorisTime artwork needs is supported: 8-bit greyscale, RGB,
+# palette and RGBA images without interlacing. Pixels are handled as lists of
+# (r, g, b, a) tuples in row-major order.
+
+import struct
+import zlib
+
+SIGNATURE = b'\x89PNG\r\n\x1a\n'
+
+
+def read_chunks(data):
+    if data[:8] != SIGNATURE:
+        raise ValueError('not a PNG file')
+    pos = 8
+    while pos < len(data):
+        length, kind = struct.unpack('>I4s', data[pos:pos + 8])
+        yield kind, data[pos + 8:pos + 8 + length]
+        pos += 12 + length
+
+
+def _paeth(a, b, c):
+    p = a + b - c
+    pa, pb, pc = abs(p - a), abs(p - b), abs(p - c)
+    if pa <= pb and pa <= pc:
+        return a
+    if pb <= pc:
+        return b
+    return c
+
+
+def unfilter(raw, width, height, bpp):
+    """Undo PNG scanline filtering, returning a list of byte rows."""
+    stride = width * bpp
+    rows = []
+    prev = bytearray(stride)
+    pos = 0
+    for _ in range(height):
+        kind = raw[pos]
+        line = bytearray(raw[pos + 1:pos + 1 + stride])
+        pos += 1 + stride
+        for i in range(stride):
+            left = line[i - bpp] if i >= bpp else 0
+            up = prev[i]
+            if kind == 1:
+                line[i] = (line[i] + left) & 0xff
+            elif kind == 2:
+                line[i] = (line[i] + up) & 0xff
+            elif kind == 3:
+                line[i] = (line[i] + ((left + up) >> 1)) & 0xff
+            elif kind == 4:
+                upleft = prev[i - bpp] if i >= bpp else 0
+                line[i] = (line[i] + _paeth(left, up, upleft)) & 0xff
+        rows.append(line)
+        prev = line
+    return rows
+
+
+class Header(object):
+    def __init__(self, body):
+        (self.width, self.height, self.depth, self.color_type,
+         _, _, self.interlace) = struct.unpack('>IIBBBBB', body)
+        if self.depth != 8 or self.interlace:
+            raise ValueError('only 8-bit non-interlaced PNGs are supported')
+        self.bpp = {0: 1, 2: 3, 3: 1, 4: 2, 6: 4}[self.color_type]
+
+
+def to_rgba(header, rows, width, height, palette, trns):
+    """Convert unfiltered rows of the given size to RGBA tuples."""
+    pixels = []
+    for y in range(height):
+        line = rows[y]
+        for x in range(width):
+            if header.color_type == 3:
+                i = line[x]
+                r, g, b = palette[i]
+                a = trns[i] if i < len(trns) else 255
+            elif header.color_type == 6:
+                r, g, b, a = line[x * 4:x * 4 + 4]
+            elif header.color_type == 2:
+                r, g, b = line[x * 3:x * 3 + 3]
+                a = 255
+            elif header.color_type == 4:
+                r = g = b = line[x * 2]
+                a = line[x * 2 + 1]
+            else:
+                r = g = b = line[x]
+                a = 255
+            pixels.append((r, g, b, a))
+    return pixels
+
+
+def read_palette(body):
+    return [tuple(body[i:i + 3]) for i in range(0, len(body), 3)]
+
+
+def read(path):
+    """Read a still PNG. Returns (width, height, pixels)."""
+    with open(path, 'rb') as f:
+        data = f.read()
+    header = None
+    palette, trns, idat = [], b'', b''
+    for kind, body in read_chunks(data):
+        if kind == b'IHDR':
+            header = Header(body)
+        elif kind == b'PLTE':
+            palette = read_palette(body)
+        elif kind == b'tRNS':
+            trns = body
+        elif kind == b'IDAT':
+            idat += body
+    rows = unfilter(zlib.decompress(idat), header.width, header.height, header.bpp)
+    return header.width, header.height, to_rgba(header, rows, header.width, header.height, palette, trns)
+
+
+def _chunk(kind, body):
+    return (struct.pack('>I', len(body)) + kind + body +
+            struct.pack('>I', zlib.crc32(kind + body) & 0xffffffff))
+
+
+def write(path, width, height, pixels):
+    """Write RGBA pixels as a PNG, palettized when there are few enough colours."""
+    colors = sorted(set(pixels), key=lambda c: c[3])
+    if len(colors) <= 256:
+        index = dict((c, i) for i, c in enumerate(colors))
+        raw = b''.join(b'\x00' + bytes(index[p] for p in pixels[y * width:(y + 1) * width])
+                       for y in range(height))
+        trns = bytes(c[3] for c in colors)
+        while trns and trns[-1] == 255:
+            trns = trns[:-1]
+        body = _chunk(b'IHDR', struct.pack('>IIBBBBB', width, height, 8, 3, 0, 0, 0))
+        body += _chunk(b'PLTE', b''.join(bytes(c[:3]) for c in colors))
+        if trns:
+            body += _chunk(b'tRNS', trns)
+    else:
+        raw = b''.join(b'\x00' + b''.join(bytes(p) for p in pixels[y * width:(y + 1) * width])
+                       for y in range(height))
+        body = _chunk(b'IHDR', struct.pack('>IIBBBBB', width, height, 8, 6, 0, 0, 0))
+    body += _chunk(b'IDAT', zlib.compress(raw, 9))
+    body += _chunk(b'IEND', b'')
+    with open(path, 'wb') as f:
+        f.write(SIGNATURE + body)
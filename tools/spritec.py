@@ -0,0 +1,209 @@
+# Compiles the Boris APNGs into the sprite format read by src/c/sprite.c.
+#
+# Colours are reduced to the watch's GColor8 and stored as indices into a
+# per-animation palette of 1, 2, 4 or 8 bits per pixel. The ~bw variants for
+# black and white watches are ordered dithered to black and white first. Each frame only
+# stores the rectangle that changed since the previous frame, run-length
+# encoded. Frame 0 is drawn on a cleared canvas so it is always complete.
+#
+# Layout, all little endian:
+#
+#   header   'B' 'S' version bpp width height frameCount paletteSize
+#   palette  paletteSize GColor8 bytes, index 0 is always transparent
+#   index    frameCount x (uint32 offset, uint16 size, uint16 delay ms)
+#   frames   x y w h, then RLE tokens for w * h indices in row order
+#
+# An RLE token byte with the top bit set repeats the next byte's index
+# (token & 0x7f) + 1 times. Otherwise (token + 1) indices follow, packed
+# bpp bits at a time with the first index in the high bits.
+#
+# Frames whose record (changed rectangle and pixels) is the same as an
+# earlier frame's share its bytes, both index entries point at them. Loops
+# that go back and forth between poses repeat most of their records.
+#
+# Behaviours that are another one flipped left to right get no sprite of
+# their own, see mirrored() and resources/behaviours.json.
+#
+# measure() works out the energy a full play of a compiled sprite takes in
+# the host simulator's units (see host/pebble_host.c). tools/behavc.py puts
+# it in the behaviour table the watch budgets behaviours with.
+
+import os
+import struct
+import sys
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+import apng
+
+VERSION = 1
+HEADER_SIZE = 8
+INDEX_ENTRY_SIZE = 8
+MAX_RUN = 128
+# SPRITE_MAX_COLORS in src/c/budget.h, the palette the watch keeps per sprite
+MAX_COLORS = 32
+CLEAR = 0x00
+BLACK = 0xc0
+WHITE = 0xff
+BAYER = [[0, 8, 2, 10], [12, 4, 14, 6], [3, 11, 1, 9], [15, 7, 13, 5]]
+
+# Energy units, the same as COST_* in host/pebble_host.c. Every frame is a
+# wakeup, an index read and streamed reads of the frame data, and a redraw
+# of the whole window
+COST_WAKEUP = 50.0
+COST_FLASH_READ = 5.0
+COST_FLASH_BYTE = 0.05
+COST_RENDER = 50.0
+READ_BUFFER_SIZE = 128
+
+
+def gcolor8(pixel):
+    r, g, b, a = pixel
+    if a < 128:
+        return CLEAR
+    return 0xc0 | (r >> 6) << 4 | (g >> 6) << 2 | (b >> 6)
+
+
+def dither(image, width):
+    out = []
+    for i, color in enumerate(image):
+        if color == CLEAR:
+            out.append(CLEAR)
+            continue
+        r, g, b = (color >> 4) & 3, (color >> 2) & 3, color & 3
+        luma = (299 * r + 587 * g + 114 * b) / 3000.0
+        threshold = (BAYER[i // width % 4][i % width % 4] + 0.5) / 16
+        out.append(WHITE if luma > threshold else BLACK)
+    return out
+
+
+def changed_rect(prev, cur, width, height):
+    xs = []
+    ys = []
+    for y in range(height):
+        for x in range(width):
+            if prev[y * width + x] != cur[y * width + x]:
+                xs.append(x)
+                ys.append(y)
+    if not xs:
+        return 0, 0, 0, 0
+    return min(xs), min(ys), max(xs) - min(xs) + 1, max(ys) - min(ys) + 1
+
+
+def pack(indices, bpp):
+    out = bytearray()
+    per_byte = 8 // bpp
+    for i in range(0, len(indices), per_byte):
+        byte = 0
+        for j, index in enumerate(indices[i:i + per_byte]):
+            byte |= index << (8 - bpp * (j + 1))
+        out.append(byte)
+    return out
+
+
+def rle(indices, bpp):
+    out = bytearray()
+    literal = []
+
+    def flush():
+        while literal:
+            chunk = literal[:MAX_RUN]
+            del literal[:MAX_RUN]
+            out.append(len(chunk) - 1)
+            out.extend(pack(chunk, bpp))
+
+    i = 0
+    while i < len(indices):
+        run = 1
+        while i + run < len(indices) and run < MAX_RUN and indices[i + run] == indices[i]:
+            run += 1
+        # A run token costs two bytes, only worth it over a few pixels
+        if run * bpp > 16 or run == len(indices) - i and run > 1:
+            flush()
+            out.append(0x80 | (run - 1))
+            out.append(indices[i])
+            i += run
+        else:
+            literal.append(indices[i])
+            i += 1
+    flush()
+    return out
+
+
+def compile_frames(width, height, frames, bw=False):
+    images = [[gcolor8(p) for p in pixels] for pixels, _ in frames]
+    if bw:
+        images = [dither(image, width) for image in images]
+    colors = [CLEAR] + sorted(set(c for image in images for c in image) - set([CLEAR]))
+    if len(colors) > MAX_COLORS:
+        raise ValueError('{} colours, the watch keeps {} per sprite'.format(len(colors), MAX_COLORS))
+    bpp = next(b for b in (1, 2, 4, 8) if len(colors) <= 1 << b)
+    lookup = dict((c, i) for i, c in enumerate(colors))
+
+    body = bytearray()
+    index = bytearray()
+    offset = HEADER_SIZE + len(colors) + INDEX_ENTRY_SIZE * len(frames)
+    records = {}
+    prev = [CLEAR] * (width * height)
+    for image, (_, delay) in zip(images, frames):
+        x, y, w, h = changed_rect(prev, image, width, height)
+        data = bytes(struct.pack('<BBBB', x, y, w, h) +
+                     rle([lookup[image[(y + row) * width + x + col]] for row in range(h) for col in range(w)], bpp))
+        if data not in records:
+            records[data] = offset + len(body)
+            body += data
+        index += struct.pack('<IHH', records[data], len(data), min(delay, 0xffff))
+        prev = image
+
+    header = struct.pack('<2sBBBBBB', b'BS', VERSION, bpp, width, height, len(frames), len(colors))
+    return header + bytes(colors) + index + body
+
+
+def flipped(pixels, width):
+    return [p for y in range(0, len(pixels), width) for p in reversed(pixels[y:y + width])]
+
+
+def mirrored(source, other):
+    """Whether animation other is source flipped left to right with the same
+    timing, so the watch can show it from source's sprite. Both are as
+    apng.read() returns them."""
+    width, height, frames = source
+    other_width, other_height, other_frames = other
+    if (width, height, len(frames)) != (other_width, other_height, len(other_frames)):
+        return False
+    return all(delay == other_delay and flipped([gcolor8(p) for p in pixels], width) ==
+               [gcolor8(p) for p in other_pixels]
+               for (pixels, delay), (other_pixels, other_delay) in zip(frames, other_frames))
+
+
+def needs_update(source, target):
+    return not os.path.exists(target) or os.path.getmtime(source) > os.path.getmtime(target)
+
+
+def build(source, target, bw_target=None):
+    """Compile source to target, and to a black and white bw_target if given."""
+    width, height, frames = apng.read(source)
+    if width > 255 or height > 255 or len(frames) > 255:
+        raise ValueError('{} is too large for a sprite'.format(source))
+    with open(target, 'wb') as f:
+        f.write(compile_frames(width, height, frames))
+    if bw_target:
+        with open(bw_target, 'wb') as f:
+            f.write(compile_frames(width, height, frames, bw=True))
+
+
+def measure(data):
+    """Returns (frames, duration ms, energy) for one play of a compiled sprite."""
+    width, height, count, palette_size = struct.unpack('<BBBB', data[4:8])
+    duration = 0
+    energy = 0.0
+    for i in range(count):
+        _, size, delay = struct.unpack_from('<IHH', data, HEADER_SIZE + palette_size + i * INDEX_ENTRY_SIZE)
+        reads = 1 + (size + READ_BUFFER_SIZE - 1) // READ_BUFFER_SIZE
+        energy += (COST_WAKEUP + reads * COST_FLASH_READ + (INDEX_ENTRY_SIZE + size) * COST_FLASH_BYTE +
+                   COST_RENDER)
+        duration += delay
+    return count, duration, int(round(energy))
+
+
+if __name__ == '__main__':
+    build(*sys.argv[1:4])
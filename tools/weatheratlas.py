@@ -0,0 +1,40 @@
+# Packs the OpenWeatherMap condition icons into one sprite sheet resource.
+#
+# The icons are stacked vertically in WEATHER_ICONS order, so icon n lives at
+# y = n * ICON_SIZE. That order must match weatherIconSlots in src/c/main.c.
+
+import os
+import sys
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+import pngfile
+
+ICON_SIZE = 32
+WEATHER_ICONS = ['01d', '01n', '02d', '02n', '03d', '03n', '04d', '04n',
+                 '09d', '09n', '10d', '10n', '11d', '11n', '13d', '13n',
+                 '50d', '50n']
+
+
+def sources(icon_dir):
+    return [os.path.join(icon_dir, code + '.png') for code in WEATHER_ICONS]
+
+
+def needs_update(icon_dir, target):
+    if not os.path.exists(target):
+        return True
+    mtime = os.path.getmtime(target)
+    return any(os.path.getmtime(path) > mtime for path in sources(icon_dir))
+
+
+def build(icon_dir, target):
+    pixels = []
+    for path in sources(icon_dir):
+        width, height, icon = pngfile.read(path)
+        if (width, height) != (ICON_SIZE, ICON_SIZE):
+            raise ValueError('{} is not {}x{}'.format(path, ICON_SIZE, ICON_SIZE))
+        pixels += icon
+    pngfile.write(target, ICON_SIZE, ICON_SIZE * len(WEATHER_ICONS), pixels)
+
+
+if __name__ == '__main__':
+    build(sys.argv[1], sys.argv[2])